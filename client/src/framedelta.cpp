@@ -0,0 +1,124 @@
+#include "framedelta.h"
+#include "tas.h"
+
+#include <cstring>
+
+namespace cly::framedelta {
+
+bool Decoder::init(const u8* data, u32 size) {
+	if (size < sizeof(Header)) return false;
+
+	Header header;
+	memcpy(&header, data, sizeof(Header));
+
+	mCur = data + sizeof(Header);
+	mEnd = data + size;
+	mRemaining = header.frameCount;
+
+	// primed so the first record picks up frameIndex/serverIndex from the header
+	memset(&mPrev, 0, sizeof(mPrev));
+	mPrev.nextFrameIndex = header.frameIndex;
+	mPrev.serverIndex = header.serverIndex - 1;
+	return true;
+}
+
+bool Decoder::readVarInt(u32* out) {
+	u32 value = 0;
+	for (u32 i = 0; i < cMaxVarIntSize; i++) {
+		if (mCur >= mEnd) return false;
+		u8 byte = *mCur++;
+		value |= u32(byte & 0x7f) << (i * 7);
+		if (!(byte & 0x80)) {
+			*out = value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool Decoder::next(Server::FramePacket* out) {
+	if (mRemaining == 0) return false;
+
+	u16 mask;
+	if (mEnd - mCur < s64(sizeof(mask))) return false;
+	memcpy(&mask, mCur, sizeof(mask));
+	mCur += sizeof(mask);
+
+	u32 run;
+	if (!readVarInt(&run)) return false;
+
+	*out = mPrev;
+	out->frameIndex = mPrev.nextFrameIndex;
+	out->nextFrameIndex = run == 0 ? tas::System::cNoNextFrame : out->frameIndex + run;
+	out->serverIndex = mPrev.serverIndex + 1;
+
+	u8* base = cast<u8*>(out);
+	for (s32 i = 0; i < cFieldNum; i++) {
+		if (!(mask & (1 << i))) continue;
+
+		const Field& field = cFields[i];
+		if (mEnd - mCur < field.size) return false;
+		memcpy(base + field.offset, mCur, field.size);
+		mCur += field.size;
+	}
+
+	mPrev = *out;
+	mRemaining--;
+	return true;
+}
+
+void Encoder::init(u8* buf, u32 capacity, u32 serverIndex, u32 frameIndex) {
+	mBuf = buf;
+	mCapacity = capacity;
+	mSize = sizeof(Header);
+	mCount = 0;
+	memset(&mPrev, 0, sizeof(mPrev));
+
+	Header header = { .serverIndex = serverIndex, .frameIndex = frameIndex, .frameCount = 0 };
+	memcpy(mBuf, &header, sizeof(Header));
+}
+
+void Encoder::writeVarInt(u32 value) {
+	while (value >= 0x80) {
+		mBuf[mSize++] = u8(value) | 0x80;
+		value >>= 7;
+	}
+	mBuf[mSize++] = u8(value);
+}
+
+bool Encoder::push(const Server::FramePacket& frame) {
+	if (mCapacity - mSize < cMaxRecordSize || mCount == 0xFFFF) return false;
+
+	const u8* cur = cast<const u8*>(&frame);
+	const u8* prev = cast<const u8*>(&mPrev);
+
+	u16 mask = 0;
+	for (s32 i = 0; i < cFieldNum; i++) {
+		const Field& field = cFields[i];
+		if (memcmp(cur + field.offset, prev + field.offset, field.size) != 0) mask |= 1 << i;
+	}
+	memcpy(mBuf + mSize, &mask, sizeof(mask));
+	mSize += sizeof(mask);
+
+	writeVarInt(frame.nextFrameIndex == tas::System::cNoNextFrame ? 0 : frame.nextFrameIndex - frame.frameIndex);
+
+	for (s32 i = 0; i < cFieldNum; i++) {
+		if (!(mask & (1 << i))) continue;
+
+		const Field& field = cFields[i];
+		memcpy(mBuf + mSize, cur + field.offset, field.size);
+		mSize += field.size;
+	}
+
+	mPrev = frame;
+	mCount++;
+	return true;
+}
+
+u32 Encoder::finish() {
+	memcpy(mBuf + offsetof(Header, frameCount), &mCount, sizeof(mCount));
+	return mSize;
+}
+
+} // namespace cly::framedelta
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "server.h"
+
+#include <hk/types.h>
+
+#include <cstddef>
+
+namespace cly::framedelta {
+
+/*
+ * a FrameDelta packet body is a Header followed by `frameCount` records.
+ * each record is:
+ *   u16     dirty mask, one bit per entry of cFields
+ *   varint  run length: nextFrameIndex - frameIndex, or 0 if there is no next frame
+ *   ...     the raw bytes of every field whose bit is set, in cFields order
+ *
+ * the first record is relative to an all-zero frame, and every record after it is relative to the previous one,
+ * so each packet can be decoded on its own. frameIndex and serverIndex are implied:
+ * a record's frameIndex is the previous record's nextFrameIndex, and serverIndex counts up by one per record.
+ */
+
+struct [[gnu::packed]] Header {
+	u32 serverIndex;
+	u32 frameIndex;
+	u16 frameCount;
+};
+
+struct Field {
+	u16 offset;
+	u16 size;
+};
+
+#define CLY_CONTROLLER_FIELDS(PLAYER)                                                                                                                          \
+	{ offsetof(Server::FramePacket, PLAYER) + offsetof(Server::Controller, buttons), sizeof(Server::Controller::buttons) },                                     \
+		{ offsetof(Server::FramePacket, PLAYER) + offsetof(Server::Controller, leftStick), sizeof(Server::Controller::leftStick) },                             \
+		{ offsetof(Server::FramePacket, PLAYER) + offsetof(Server::Controller, rightStick), sizeof(Server::Controller::rightStick) },                           \
+		{ offsetof(Server::FramePacket, PLAYER) + offsetof(Server::Controller, accelLeft), sizeof(Server::Controller::accelLeft) },                             \
+		{ offsetof(Server::FramePacket, PLAYER) + offsetof(Server::Controller, accelRight), sizeof(Server::Controller::accelRight) }
+
+constexpr Field cFields[] = {
+	CLY_CONTROLLER_FIELDS(player1),
+	CLY_CONTROLLER_FIELDS(player2),
+	{ offsetof(Server::FramePacket, amiibo), sizeof(Server::FramePacket::amiibo) },
+};
+
+#undef CLY_CONTROLLER_FIELDS
+
+constexpr s32 cFieldNum = sizeof(cFields) / sizeof(Field);
+static_assert(cFieldNum <= 16, "dirty mask is only 16 bits");
+
+constexpr u32 cMaxVarIntSize = 5;
+
+// worst case: every field changed
+constexpr u32 cMaxRecordSize = sizeof(u16) + cMaxVarIntSize + sizeof(Server::FramePacket) - offsetof(Server::FramePacket, player1);
+
+class Decoder {
+	const u8* mCur = nullptr;
+	const u8* mEnd = nullptr;
+	Server::FramePacket mPrev;
+	u32 mRemaining = 0;
+
+	bool readVarInt(u32* out);
+
+public:
+	// returns false if `data` doesn't even hold a header
+	bool init(const u8* data, u32 size);
+
+	u32 getRemaining() const { return mRemaining; }
+
+	// serverIndex of the record `next` will decode
+	u32 getNextServerIndex() const { return mPrev.serverIndex + 1; }
+
+	// decodes the next record into `out`. returns false if there are no records left or the packet is malformed
+	bool next(Server::FramePacket* out);
+};
+
+// the client side counterpart of the server's encoder, for packets that originate on the console
+class Encoder {
+	u8* mBuf = nullptr;
+	u32 mCapacity = 0;
+	u32 mSize = 0;
+	u16 mCount = 0;
+	Server::FramePacket mPrev;
+
+	void writeVarInt(u32 value);
+
+public:
+	// starts a new packet in `buf`, whose first record will be frame `frameIndex` with serverIndex `serverIndex`.
+	// `capacity` has to hold at least the header and one record
+	void init(u8* buf, u32 capacity, u32 serverIndex, u32 frameIndex);
+
+	// appends a record. the frame's frameIndex and serverIndex have to follow on from the previous one, as they're implied.
+	// returns false if the packet is full
+	bool push(const Server::FramePacket& frame);
+
+	u32 getCount() const { return mCount; }
+
+	// writes the final record count into the header and returns the packet's size
+	u32 finish();
+};
+
+} // namespace cly::framedelta
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <atomic>
+
+namespace cly {
+
+// lock-free single-producer/single-consumer ring buffer.
+// the producer reserves the next free slot with `beginWrite`, fills it in place, then publishes it with `endWrite`.
+// the consumer borrows the oldest published slot with `peek` and hands it back to the producer with `pop`.
+template <typename T, s32 Capacity>
+class FrameRing {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "FrameRing capacity must be a power of two");
+
+	constexpr static u32 cIndexMask = Capacity - 1;
+	constexpr static s32 cCacheLineSize = 64;
+
+	// indices are free-running and only masked when addressing mBuf, so `write - read` is always the fill level.
+	// each side keeps a stale copy of the other side's index so it only touches the shared cache line when it looks full/empty.
+
+	// the two halves are kept a full cache line apart by padding rather than alignas,
+	// since rings live inside singletons allocated from a sead::Heap that doesn't honour extended alignment
+
+	// producer-owned
+	std::atomic<u32> mWriteIdx = 0;
+	u32 mCachedReadIdx = 0;
+	u8 mProducerPadding[cCacheLineSize];
+
+	// consumer-owned
+	std::atomic<u32> mReadIdx = 0;
+	u32 mCachedWriteIdx = 0;
+	u8 mConsumerPadding[cCacheLineSize];
+
+	T mBuf[Capacity];
+
+public:
+	constexpr static s32 capacity = Capacity;
+
+	/* producer */
+
+	// returns nullptr if the ring is full
+	T* beginWrite() {
+		u32 count = 1;
+		return beginWrite(count);
+	}
+
+	// reserves up to `count` contiguous slots, clamping `count` to what is free before the ring wraps around.
+	// returns nullptr if the ring is full
+	T* beginWrite(u32& count) {
+		const u32 write = mWriteIdx.load(std::memory_order_relaxed);
+		if (write - mCachedReadIdx + count > u32(Capacity)) mCachedReadIdx = mReadIdx.load(std::memory_order_acquire);
+
+		const u32 free = u32(Capacity) - (write - mCachedReadIdx);
+		const u32 untilWrap = u32(Capacity) - (write & cIndexMask);
+		if (count > free) count = free;
+		if (count > untilWrap) count = untilWrap;
+		if (count == 0) return nullptr;
+
+		return &mBuf[write & cIndexMask];
+	}
+
+	void endWrite(u32 count = 1) { mWriteIdx.store(mWriteIdx.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+	/* consumer */
+
+	// returns nullptr if the ring is empty
+	const T* peek() {
+		const u32 read = mReadIdx.load(std::memory_order_relaxed);
+		if (read == mCachedWriteIdx) {
+			mCachedWriteIdx = mWriteIdx.load(std::memory_order_acquire);
+			if (read == mCachedWriteIdx) return nullptr;
+		}
+		return &mBuf[read & cIndexMask];
+	}
+
+	void pop() { mReadIdx.store(mReadIdx.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	// drops every published slot. this is a consumer-side operation,
+	// so it must only be called while nothing is peeking at the ring (i.e. while not replaying)
+	void clear() {
+		mCachedWriteIdx = mWriteIdx.load(std::memory_order_acquire);
+		mReadIdx.store(mCachedWriteIdx, std::memory_order_release);
+	}
+
+	/* either side */
+
+	// only a snapshot: the other side may be moving concurrently
+	u32 size() const { return mWriteIdx.load(std::memory_order_acquire) - mReadIdx.load(std::memory_order_acquire); }
+
+	bool isFull() const { return size() >= u32(Capacity); }
+};
+
+} // namespace cly
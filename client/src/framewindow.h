@@ -0,0 +1,91 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <atomic>
+
+namespace cly {
+
+// lock-free single-producer/single-consumer window of frames, direct-mapped by a dense key (the frame's serverIndex).
+// the consumer only ever wants the frame with the lowest unreleased key (`base`), so the window covers
+// keys [base, base + Capacity) and the frame with key `k` always lives in slot `k % Capacity`.
+// frames may arrive out of order or more than once: anything behind the window or already present is ignored,
+// so a retransmit never displaces a frame that's still waiting to be played
+template <typename T, s32 Capacity>
+class FrameWindow {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "FrameWindow capacity must be a power of two");
+
+	constexpr static u32 cIndexMask = Capacity - 1;
+	constexpr static s32 cCacheLineSize = 64;
+
+	// key + 1 once the slot's frame is published, 0 while it's empty
+	std::atomic<u32> mTags[Capacity] = {};
+	u8 mTagPadding[cCacheLineSize];
+
+	// consumer-owned. slots are emptied before the base moves past them, so the producer can't see a stale tag
+	std::atomic<u32> mBase = 0;
+	u8 mConsumerPadding[cCacheLineSize];
+
+	T mBuf[Capacity];
+
+public:
+	constexpr static s32 capacity = Capacity;
+
+	/* producer */
+
+	// returns the slot to fill in for `key`, or nullptr if that frame isn't wanted:
+	// it was already played, is already buffered, or is too far ahead (in which case `isFull` is set)
+	T* beginWrite(u32 key, bool* isFull) {
+		const u32 base = mBase.load(std::memory_order_acquire);
+		*isFull = false;
+
+		if (s32(key - base) < 0) return nullptr;
+		if (key - base >= u32(Capacity)) {
+			*isFull = true;
+			return nullptr;
+		}
+		if (mTags[key & cIndexMask].load(std::memory_order_relaxed) == key + 1) return nullptr;
+
+		return &mBuf[key & cIndexMask];
+	}
+
+	void endWrite(u32 key) { mTags[key & cIndexMask].store(key + 1, std::memory_order_release); }
+
+	/* consumer */
+
+	// returns nullptr if the frame at the base of the window hasn't arrived yet
+	const T* peek() {
+		const u32 base = mBase.load(std::memory_order_relaxed);
+		if (mTags[base & cIndexMask].load(std::memory_order_acquire) != base + 1) return nullptr;
+		return &mBuf[base & cIndexMask];
+	}
+
+	// releases the frame at the base and slides the window forward by one
+	void pop() {
+		const u32 base = mBase.load(std::memory_order_relaxed);
+		mTags[base & cIndexMask].store(0, std::memory_order_relaxed);
+		mBase.store(base + 1, std::memory_order_release);
+	}
+
+	// empties the window and moves it to start at `base`.
+	// nothing may be reading or writing the window concurrently (i.e. only while not replaying)
+	void reset(u32 base = 0) {
+		for (s32 i = 0; i < Capacity; i++)
+			mTags[i].store(0, std::memory_order_relaxed);
+		mBase.store(base, std::memory_order_release);
+	}
+
+	/* either side */
+
+	// frames buffered from the base onwards without a gap, i.e. how many can be played before blocking.
+	// only a snapshot: the other side may be moving concurrently
+	u32 size() const {
+		const u32 base = mBase.load(std::memory_order_acquire);
+		u32 count = 0;
+		while (count < u32(Capacity) && mTags[(base + count) & cIndexMask].load(std::memory_order_acquire) == base + count + 1)
+			count++;
+		return count;
+	}
+};
+
+} // namespace cly
@@ -1,5 +1,8 @@
 #include <hk/hook/Trampoline.h>
 
+#include <cstring>
+
+#include <sead/controller/seadControllerMgr.h>
 #include <sead/filedevice/seadFileDeviceMgr.h>
 
 #include "Library/Base/StringUtil.h"
@@ -15,9 +18,44 @@
 
 #include "main.h"
 #include "menu.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "savestate.h"
+#include "statehash.h"
 #include "tas.h"
 
 namespace cly {
+
+namespace {
+
+// the drawKit hooks run for every draw list on every frame, so both checks are kept cheap.
+// nerves are static singletons, so a nerve pointer identifies its type and the nerve check is cached by pointer.
+// executor list names aren't known to be literals, so a pointer can't stand in for one. the list check compares
+// the name's first few bytes instead, which costs about as much as a cache lookup keyed on them would
+class UiDrawFilter {
+	// 2D layout lists are named "２Ｄ..." in full-width characters
+	constexpr static char c2DPrefix[] = "２Ｄ";
+
+	const al::Nerve* mNerve = nullptr;
+	bool mIsSceneNrvPlay = false;
+
+public:
+	bool isSceneNrvPlay(const al::Scene* scene) {
+		const al::Nerve* nerve = al::getCurrentNerve(scene);
+		if (nerve != mNerve) {
+			mNerve = nerve;
+			mIsSceneNrvPlay = nerve && al::isEndWithString(util::getTypeName(nerve), "StageSceneNrvPlayE");
+		}
+		return mIsSceneNrvPlay;
+	}
+
+	static bool isList2D(const char* name) { return strncmp(name, c2DPrefix, sizeof(c2DPrefix) - 1) == 0; }
+};
+
+UiDrawFilter sUiDrawFilter;
+
+} // namespace
+
 void setupHooks() {
 	HkTrampoline gameSystemInit = [](TrampolineStatic(), GameSystem* gameSystem) -> void {
 		initSystem();
@@ -26,36 +64,61 @@ void setupHooks() {
 
 	HkTrampoline gameSystemDraw = [](TrampolineStatic(), GameSystem* gameSystem) -> void {
 		if (tas::Pauser::instance()->isSequenceActive()) orig(gameSystem);
-		tas::Pauser::instance()->update();
-		Menu::instance()->draw();
+		{
+			profiler::Scope scope(profiler::cHook_GameSystemDraw);
+			tas::Pauser::instance()->update();
+			Menu::instance()->draw();
+		}
+		profiler::endFrame();
 	};
 
 	HkTrampoline gameSystemUpdate = [](TrampolineStatic(), GameSystem* gameSystem) -> void {
-		if (tas::Pauser::instance()->isSequenceActive()) orig(gameSystem);
+		// fast forward runs several game frames back to back, and only the last of them gets drawn.
+		// controllers are normally only calculated once per vsync, so each extra frame calculates them to pick up its script frame
+		const u64 startTick = util::getSystemTick();
+		s32 framesRun = 0;
+		do {
+			if (framesRun > 0) sead::ControllerMgr::instance()->calc();
+			Server::beginTelemetryFrame();
+			if (tas::Pauser::instance()->isSequenceActive()) orig(gameSystem);
+			profiler::Scope scope(profiler::cHook_GameSystemUpdate);
+			tas::System::checkForNextFrame();
+			Server::flushTelemetry();
+			framesRun++;
+		} while (tas::Pauser::instance()->canRunExtraFrame(framesRun, util::getSystemTick() - startTick));
+
+		profiler::Scope scope(profiler::cHook_GameSystemUpdate);
 
 		static u8 discoveryTimer = 30;
 		if (--discoveryTimer == 0) {
 			discoveryTimer = 30;
 			Server::instance()->sendUDPDiscoveryBroadcast();
 		}
-
-		tas::System::checkForNextFrame();
 	};
 
 	HkTrampoline sceneInit = [](TrampolineStatic(), al::Scene* scene, const char* stageName, s32 scenarioNo) -> void {
 		Server::reportStageName(stageName, scenarioNo);
+		statehash::setStage(stageName, scenarioNo);
 		tas::Pauser::instance()->setWaitingOnLoad(false);
+		SaveStates::handleSceneInit();
 		orig(scene, stageName, scenarioNo);
+		Server::reportStageLoaded();
 	};
 
 	HkTrampoline sceneMovement = [](TrampolineStatic(), al::Scene* scene) -> void {
 		orig(scene);
-		if (al::LiveActor* player = rs::getPlayerActor(scene)) Server::reportPlayerPosition(al::getTrans(player));
+		profiler::Scope scope(profiler::cHook_SceneMovement);
+		al::LiveActor* player = rs::getPlayerActor(scene);
+		if (player) Server::reportPlayerPosition(al::getTrans(player));
+		Server::reportStateHash(statehash::compute(player));
 		if (tas::System::isReplaying()) tas::System::getNextFrame();
+		tas::Recorder::endFrame();
+		SaveStates::update(scene);
 	};
 
 	HkTrampoline npadControllerCalc = [](TrampolineStatic(), al::NpadController* controller) -> void {
 		orig(controller);
+		profiler::Scope scope(profiler::cHook_NpadControllerCalc);
 		tas::System::processInputs(controller);
 	};
 
@@ -71,22 +134,28 @@ void setupHooks() {
 
 	static HkTrampoline getNpadStates = [](TrampolineStatic(), nn::hid::NpadJoyDualState* states, s32 count, const u32& port) -> void {
 		orig(states, count, port);
+		profiler::Scope scope(profiler::cHook_GetNpadStates);
 		if (count >= 1) Server::reportInput(states[0]);
 	};
 
+	// these run for every draw list of every frame, but only do any work while the ui is hidden, so only then are they timed
 	HkTrampoline drawKit = [](TrampolineStatic(), al::Scene* scene, const char* executorList) -> void {
-		bool showUi = Server::instance()->tools.showUi;
-		bool isSceneNrvPlay = al::isEndWithString(util::getTypeName(al::getCurrentNerve(scene)), "StageSceneNrvPlayE");
-		bool isList2D = al::isStartWithString(executorList, "２Ｄ");
-		if (!showUi && isSceneNrvPlay && isList2D) return;
+		bool isHidden = false;
+		if (!Server::instance()->tools.showUi) {
+			profiler::Scope scope(profiler::cHook_DrawKit);
+			isHidden = sUiDrawFilter.isList2D(executorList) && sUiDrawFilter.isSceneNrvPlay(scene);
+		}
+		if (isHidden) return;
 		orig(scene, executorList);
 	};
 
 	HkTrampoline drawKitList = [](TrampolineStatic(), al::Scene* scene, const char* executorList, const char* otherExecutorList) -> void {
-		bool showUi = Server::instance()->tools.showUi;
-		bool isSceneNrvPlay = al::isEndWithString(util::getTypeName(al::getCurrentNerve(scene)), "StageSceneNrvPlayE");
-		bool isList2D = al::isStartWithString(executorList, "２Ｄ") || al::isStartWithString(otherExecutorList, "２Ｄ");
-		if (!showUi && isSceneNrvPlay && isList2D) return;
+		bool isHidden = false;
+		if (!Server::instance()->tools.showUi) {
+			profiler::Scope scope(profiler::cHook_DrawKitList);
+			isHidden = (sUiDrawFilter.isList2D(executorList) || sUiDrawFilter.isList2D(otherExecutorList)) && sUiDrawFilter.isSceneNrvPlay(scene);
+		}
+		if (isHidden) return;
 		orig(scene, executorList, otherExecutorList);
 	};
 
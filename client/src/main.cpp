@@ -1,5 +1,8 @@
 #include "main.h"
 #include "menu.h"
+#include "recorder.h"
+#include "savestate.h"
+#include "scriptcache.h"
 #include "server.h"
 #include "tas.h"
 
@@ -47,6 +50,12 @@ void initSystem() {
 	tas::System* system = tas::System::createInstance(heap);
 	system->init(heap);
 
+	ScriptCache* scriptCache = ScriptCache::createInstance(heap);
+	scriptCache->init(heap);
+
+	tas::Recorder::createInstance(heap);
+	SaveStates::createInstance(heap);
+
 	gIsInitialized = true;
 }
 } // namespace cly
@@ -1,7 +1,11 @@
 #include "menu.h"
 #include "menuitem.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "savestate.h"
 #include "server.h"
 #include "tas.h"
+#include "trace.h"
 #include "util.h"
 
 #include <hk/diag/diag.h>
@@ -41,58 +45,79 @@ void Menu::init(sead::Heap* heap) {
 	mItems = sead::PtrArray<MenuItem>();
 	mItems.tryAllocBuffer(cMenuItemNumMax, heap);
 
-	MenuItem* fpsCounter = addText({ mCellResolution.x - 1, 0 }, "FPS: N/A");
-	fpsCounter->mDrawFunc = [](MenuItem* self) -> void {
-		s32 fps = round(Application::sInstance->getGameFramework()->calcFps());
-		self->mText.format("FPS: %d", fps);
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
-
-	MenuItem* frameBuffer = addText({ mCellResolution.x - 3, 0 }, "fb: 0/0");
-	frameBuffer->mDrawFunc = [](MenuItem* self) -> void {
-		auto* server = Server::instance();
-		self->mText.format("fb: %d/%d", u32(server->mFrameBuffer.count), server->mFrameBuffer.capacity);
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
-	MenuItem* progress = addText({ mCellResolution.x - 3, 1 }, "pr: 0/0");
-	progress->mDrawFunc = [](MenuItem* self) -> void {
-		auto* system = tas::System::instance();
-		self->mText.format("pr: %d/%d", system->getFrameIndex(), system->getFrameCount());
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
-	MenuItem* paused = addText({ mCellResolution.x - 3, 2 }, "pa: -");
-	paused->mDrawFunc = [](MenuItem* self) -> void {
-		auto* pauser = tas::Pauser::instance();
-		self->mText.format("pa: %s", pauser->isSequenceActive() ? "-" : "+");
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
-	MenuItem* playing = addText({ mCellResolution.x - 3, 3 }, "pl: -");
-	playing->mDrawFunc = [](MenuItem* self) -> void {
-		auto* system = tas::System::instance();
-		self->mText.format("pl: %s", system->isReplaying() ? "+" : "-");
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
-	MenuItem* blocked = addText({ mCellResolution.x - 3, 4 }, "bl: -");
-	blocked->mDrawFunc = [](MenuItem* self) -> void {
-		auto* pauser = tas::Pauser::instance();
-		self->mText.format("bl: %s", pauser->isBlocked() ? "+" : "-");
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
-	MenuItem* fpaused = addText({ mCellResolution.x - 3, 5 }, "pm: -");
-	fpaused->mDrawFunc = [](MenuItem* self) -> void {
-		auto* pauser = tas::Pauser::instance();
-		self->mText.format("pm: %s", pauser->isManuallyPaused() ? "+" : "-");
-		self->draw_(MenuItem::cFgColorOn, MenuItem::cBgColorOff);
-	};
+	// the status items only reformat their text when the value they show changes
+	addText({ mCellResolution.x - 1, 0 }, "FPS: N/A")
+		->setValue(
+			[]() -> u64 { return u64(round(Application::sInstance->getGameFramework()->calcFps())); },
+			[](MenuItem* self, u64 fps) -> void { self->mText.format("FPS: %d", s32(fps)); }
+		);
+
+	addText({ mCellResolution.x - 3, 0 }, "fb: 0/0")
+		->setValue(
+			[]() -> u64 { return Server::instance()->mFrameBuffer.size(); },
+			[](MenuItem* self, u64 size) -> void { self->mText.format("fb: %d/%d", u32(size), Server::FrameBuffer::capacity); }
+		);
+	addText({ mCellResolution.x - 3, 1 }, "pr: 0/0")
+		->setValue(
+			[]() -> u64 { return u64(tas::System::getSpanIndex()) << 32 | tas::System::getFrameCount(); },
+			[](MenuItem* self, u64 progress) -> void { self->mText.format("pr: %d/%d", u32(progress >> 32), u32(progress)); }
+		);
+	addText({ mCellResolution.x - 3, 2 }, "pa: -")
+		->setValue(
+			[]() -> u64 { return tas::Pauser::instance()->isSequenceActive(); },
+			[](MenuItem* self, u64 isActive) -> void { self->mText.format("pa: %s", isActive ? "-" : "+"); }
+		);
+	addText({ mCellResolution.x - 3, 3 }, "pl: -")
+		->setValue(
+			[]() -> u64 { return tas::System::isReplaying(); },
+			[](MenuItem* self, u64 isReplaying) -> void { self->mText.format("pl: %s", isReplaying ? "+" : "-"); }
+		);
+	addText({ mCellResolution.x - 3, 4 }, "bl: -")
+		->setValue(
+			[]() -> u64 { return tas::Pauser::instance()->isBlocked(); },
+			[](MenuItem* self, u64 isBlocked) -> void { self->mText.format("bl: %s", isBlocked ? "+" : "-"); }
+		);
+	addText({ mCellResolution.x - 3, 5 }, "pm: -")
+		->setValue(
+			[]() -> u64 { return tas::Pauser::instance()->isManuallyPaused(); },
+			[](MenuItem* self, u64 isPaused) -> void { self->mText.format("pm: %s", isPaused ? "+" : "-"); }
+		);
+	addText({ mCellResolution.x - 3, 6 }, "un: 0/0")
+		->setValue(
+			[]() -> u64 {
+				const auto& stats = tas::System::getStats();
+				return u64(stats.underruns) << 32 | stats.blockedFrames;
+			},
+			[](MenuItem* self, u64 stats) -> void { self->mText.format("un: %d/%d", u32(stats >> 32), u32(stats)); }
+		);
+	addText({ mCellResolution.x - 3, 7 }, "po: 0/0 0/0")
+		->setValue(
+			[]() -> u64 {
+				Menu* menu = instance();
+				return u64(menu->mLogPool.getHighWater()) << 32 | u32(menu->mItemPool.getHighWater());
+			},
+			[](MenuItem* self, u64 highWater) -> void {
+				self->mText.format("po: %d/%d %d/%d", u32(highWater >> 32), cLogEntryNumMax, u32(highWater), cMenuItemNumMax);
+			}
+		);
+	addText({ mCellResolution.x - 3, 8 }, "ff: 1")
+		->setValue(
+			[]() -> u64 { return tas::Pauser::instance()->getFastForward(); },
+			[](MenuItem* self, u64 frames) -> void { self->mText.format("ff: %d", s32(frames)); }
+		);
 
 	MenuItem* itemPause = addButton({ 0, 21 }, "toggle pause", []() -> void { tas::Pauser::instance()->togglePause(); })->setSpan({ 2, 1 });
 	addButton({ 0, 22 }, "advance frame", []() -> void { tas::Pauser::instance()->advanceFrame(); })->setSpan({ 2, 1 });
+	addButton({ 2, 21 }, "save state", []() -> void { SaveStates::requestSave(); })->setSpan({ 2, 1 });
+	addButton({ 2, 22 }, "load state", []() -> void { SaveStates::requestLoad(); })->setSpan({ 2, 1 });
+	addButton({ 2, 24 }, "fast forward", []() -> void { tas::Pauser::instance()->cycleFastForward(); })->setSpan({ 2, 1 });
 
-	MenuItem* itemConnect = addButton({ 0, 24 }, "connect", []() -> void {
-								auto* server = Server::instance();
-								s32 r = server->connect();
-								if (r != 0) log("Connection error: %s\n", strerror(r));
-							})->setSpan({ 2, 1 });
+	MenuItem* itemConnect = addButton({ 0, 24 }, "connect", []() -> void { Server::instance()->requestConnect(); })->setSpan({ 2, 1 });
+
+	addButton({ 0, 25 }, "play cached", []() -> void { tas::System::startCachedReplay(); })->setSpan({ 2, 1 });
+	addButton({ 0, 26 }, "record", []() -> void { tas::Recorder::toggle(); })->setSpan({ 2, 1 });
+	addButton({ 0, 27 }, "play recording", []() -> void { tas::System::startCachedReplay(tas::Recorder::cFilePath); })->setSpan({ 2, 1 });
+	addButton({ 0, 28 }, "profiler", []() -> void { Menu::instance()->toggleProfiler(); })->setSpan({ 2, 1 });
 
 	// addButton({ 0, 25 }, "send UDP", []() -> void {
 	// 	Server* server = Server::instance();
@@ -170,6 +195,7 @@ void Menu::draw() {
 
 	for (auto& item : mItems) {
 		if (item.mUpdateFunc) item.mUpdateFunc(&item);
+		if (item.mValueFunc) item.updateValue();
 	}
 
 	agl::DrawContext* drawContext = Application::instance()->mDrawSystemInfo->drawContext;
@@ -188,6 +214,14 @@ void Menu::draw() {
 	// draw log entries
 	drawLog();
 
+	// draw latest replay trace records
+	if constexpr (trace::isEnabled(trace::cLevel_Frame)) drawTrace();
+
+	// draw per-hook frame times
+	if constexpr (profiler::isEnabled()) {
+		if (mIsProfilerShown) drawProfiler();
+	}
+
 	// draw input display
 	drawInputDisplay();
 
@@ -214,7 +248,7 @@ void Menu::drawLog() {
 		// after cEndFade = fully faded out
 		else {
 			mLog.erase(i);
-			delete entry;
+			mLogPool.destroy(entry);
 			continue;
 		}
 
@@ -225,6 +259,31 @@ void Menu::drawLog() {
 	}
 }
 
+void Menu::drawTrace() {
+	sead::FixedSafeString<128> text;
+	for (s32 i = 0; i < cTraceLineNumMax; i++) {
+		trace::Record record;
+		if (!trace::getRecord(i, &record)) break;
+
+		// formatted here rather than when recorded, so replaying itself never touches a format string
+		trace::format(record, &text);
+		hk::util::Vector2i pos = { 2, mCellResolution.y - 1 - i };
+		drawCellBackground(pos, MenuItem::cBgColorOff, { 4, 1 });
+		print(pos, MenuItem::cFgColorOn, text.cstr());
+	}
+}
+
+void Menu::drawProfiler() {
+	drawCellBackground({ 0, 0 }, MenuItem::cBgColorOff, { 4, profiler::cSeriesNum + 1 });
+	print({ 0, 0 }, MenuItem::cFgColorOn, " hook     min  avg  p99 (us)");
+
+	sead::FixedSafeString<128> text;
+	for (s32 i = 0; i < profiler::cSeriesNum; i++) {
+		profiler::format(i, &text);
+		printf({ 0, 1 + i }, " %s", text.cstr());
+	}
+}
+
 void Menu::drawInputDisplay() {
 	const Vector2f startPos = mScreenResolution - Vector2f(340, 400);
 	// const Vector2f startPos = { 100.0f, 100.0f };
@@ -321,10 +380,14 @@ void Menu::log(const char* fmt, ...) {
 	LogEntry* finalEntry = logArr[cLogEntryNumMax - 1];
 	if (finalEntry) {
 		logArr.erase(cLogEntryNumMax - 1);
-		delete finalEntry;
+		sInstance->mLogPool.destroy(finalEntry);
 	}
 
-	LogEntry* newEntry = new (sInstance->mHeap) LogEntry;
+	LogEntry* newEntry = sInstance->mLogPool.create<LogEntry>();
+	if (!newEntry) {
+		va_end(args);
+		return;
+	}
 	newEntry->text.formatV(fmt, args);
 	logArr.pushFront(newEntry);
 
@@ -332,13 +395,15 @@ void Menu::log(const char* fmt, ...) {
 }
 
 MenuItem* Menu::addText(const hk::util::Vector2i& pos, const sead::SafeString& text) {
-	MenuItem* item = new MenuItemText(this, pos, text);
+	MenuItem* item = mItemPool.create<MenuItemText>(this, pos, text);
+	HK_ABORT_UNLESS(item, "too many menu items");
 	mItems.pushBack(item);
 	return item;
 }
 
 MenuItem* Menu::addButton(const hk::util::Vector2i& pos, const sead::SafeString& text, MenuItem::FuncVoid activateFunc) {
-	MenuItem* item = new MenuItemButton(this, pos, text, activateFunc);
+	MenuItem* item = mItemPool.create<MenuItemButton>(this, pos, text, activateFunc);
+	HK_ABORT_UNLESS(item, "too many menu items");
 	mItems.pushBack(item);
 	return item;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "menuitem.h"
+#include "pool.h"
 
 #include <hk/gfx/DebugRenderer.h>
 
@@ -21,6 +22,7 @@ class Menu {
 private:
 	constexpr static s32 cMenuItemNumMax = 128;
 	constexpr static s32 cLogEntryNumMax = 10;
+	constexpr static s32 cTraceLineNumMax = 4;
 
 	struct LogEntry {
 		constexpr static s32 cFadeLength = 30;
@@ -31,12 +33,15 @@ private:
 		sead::FixedSafeString<128> text = sead::SafeString::cEmptyString;
 	};
 
+	constexpr static u32 cMenuItemSizeMax = sizeof(MenuItemText) > sizeof(MenuItemButton) ? sizeof(MenuItemText) : sizeof(MenuItemButton);
+
 	const hk::util::Vector2i mScreenResolution = { 1280, 720 };
 	hk::util::Vector2i mCellResolution = { 12, 36 };
 	hk::util::Vector2f mCellDimension = { (f32)mScreenResolution.x / mCellResolution.x, (f32)mScreenResolution.y / mCellResolution.y };
 	f32 mFontHeight = mCellDimension.y;
 	f32 mShadowOffset = 2.0f;
 	bool mIsActive = true;
+	bool mIsProfilerShown = false;
 
 	sead::Heap* mHeap = nullptr;
 	hk::gfx::DebugRenderer* mRenderer = nullptr;
@@ -45,6 +50,10 @@ private:
 	MenuItem* mSelectedItem = nullptr;
 	sead::FixedPtrArray<LogEntry, cLogEntryNumMax> mLog;
 
+	// carved out of the Calypso heap along with the menu itself, so logging and adding items never touch the heap afterwards
+	Pool<sizeof(LogEntry), cLogEntryNumMax> mLogPool;
+	Pool<cMenuItemSizeMax, cMenuItemNumMax> mItemPool;
+
 	sead::BitFlag32 mPrevHold = 0;
 
 	hk::util::Vector2f cellPosToAbsolute(const hk::util::Vector2i& cellPos) { return { cellPos.x * mCellDimension.x, cellPos.y * mCellDimension.y }; }
@@ -56,6 +65,8 @@ private:
 	}
 
 	void drawLog();
+	void drawTrace();
+	void drawProfiler();
 	void drawInputDisplay();
 	void drawQuad(const hk::util::Vector2f& pos, const hk::util::Vector2f& size, const util::Color4f& color0, const util::Color4f& color1, f32 radius = 0.0f);
 	void drawQuad(const hk::util::Vector2f& pos, const hk::util::Vector2f& size, const util::Color4f& color, f32 radius = 0.0f);
@@ -82,6 +93,8 @@ public:
 
 	static bool isActive() { return instance()->mIsActive; }
 
+	void toggleProfiler() { mIsProfilerShown = !mIsProfilerShown; }
+
 	friend class MenuItem;
 };
 
@@ -3,7 +3,9 @@
 
 namespace cly {
 
-MenuItem::MenuItem(Menu* menu, const hk::util::Vector2i& pos, const sead::FixedSafeString<128>& text) : mMenu(menu), mPos(pos), mText(text) {}
+MenuItem::MenuItem(Menu* menu, const hk::util::Vector2i& pos, const sead::FixedSafeString<128>& text) : mMenu(menu), mPos(pos), mText(text) {
+	updateDisplayText();
+}
 
 void MenuItem::draw() const {
 	draw_(cFgColorOn, cBgColorOff);
@@ -11,7 +13,7 @@ void MenuItem::draw() const {
 
 void MenuItem::draw_(const util::Color4f& fgColor, const util::Color4f& bgColor) const {
 	mMenu->drawCellBackground(mPos, bgColor, mSpan);
-	mMenu->printf(mPos, fgColor, " %s", mText.cstr());
+	mMenu->print(mPos, fgColor, mDisplayText.cstr());
 }
 
 MenuItemText::MenuItemText(Menu* menu, const hk::util::Vector2i& pos, const sead::FixedSafeString<128>& text) : MenuItem(menu, pos, text) {
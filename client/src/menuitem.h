@@ -14,6 +14,8 @@ class MenuItem {
 protected:
 	using FuncVoid = void (*)();
 	using FuncSelf = void (*)(MenuItem*);
+	using FuncValue = u64 (*)();
+	using FuncFormat = void (*)(MenuItem*, u64);
 
 	constexpr static util::Color4f cFgColorOff = { 0.7f, 0.7f, 0.7f, 0.8f };
 	constexpr static util::Color4f cFgColorOn = { 1.0f, 1.0f, 1.0f, 0.8f };
@@ -24,9 +26,16 @@ protected:
 	hk::util::Vector2i mPos = { 0, 0 };
 	hk::util::Vector2i mSpan = { 1, 1 };
 	sead::FixedSafeString<128> mText = sead::SafeString::cEmptyString;
+	// mText as it's printed, only rebuilt when mText changes
+	sead::FixedSafeString<128> mDisplayText = sead::SafeString::cEmptyString;
 	FuncVoid mActivateFunc = nullptr;
 	FuncSelf mUpdateFunc = nullptr;
 	FuncSelf mDrawFunc = nullptr;
+	// for items that show a live value: mFormatFunc rebuilds mText, but only on frames where mValueFunc returns something new
+	FuncValue mValueFunc = nullptr;
+	FuncFormat mFormatFunc = nullptr;
+	u64 mValue = 0;
+	bool mHasValue = false;
 	bool mIsSelectable = true;
 	bool mIsSelected = false;
 
@@ -37,9 +46,29 @@ public:
 
 	MenuItem* setText(const sead::FixedSafeString<128>& text) {
 		mText = text;
+		updateDisplayText();
 		return this;
 	}
 
+	MenuItem* setValue(FuncValue valueFunc, FuncFormat formatFunc) {
+		mValueFunc = valueFunc;
+		mFormatFunc = formatFunc;
+		mHasValue = false;
+		return this;
+	}
+
+	void updateDisplayText() { mDisplayText.format(" %s", mText.cstr()); }
+
+	void updateValue() {
+		u64 value = mValueFunc();
+		if (mHasValue && value == mValue) return;
+
+		mValue = value;
+		mHasValue = true;
+		mFormatFunc(this, value);
+		updateDisplayText();
+	}
+
 	MenuItem* setSpan(const hk::util::Vector2i& span) {
 		mSpan = span;
 		return this;
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace cly {
+
+// lock-free fixed-size pool of SlotNum slots of SlotSize bytes each, stored inline so the pool's owner decides which heap it lives on.
+// free slots form a stack whose head is tagged with a counter that changes on every push and pop, so a thread that
+// was preempted mid-pop can't be fooled by the same slot being freed and reused in the meantime (ABA)
+template <u32 SlotSize, s32 SlotNum>
+class Pool {
+	static_assert(SlotNum > 0, "Pool needs at least one slot");
+
+	// slots are built out of pointer-sized words, which lines every slot up for anything aligned to a pointer or less without
+	// needing alignas, since pools live inside singletons allocated from a sead::Heap that doesn't honour extended alignment
+	constexpr static u32 cAlignment = alignof(void*);
+	constexpr static u32 cStride = (SlotSize + cAlignment - 1) & ~(cAlignment - 1);
+	constexpr static u64 cTagOne = u64(1) << 32;
+
+	// low 32 bits: index + 1 of the first free slot, or 0 if there is none. high 32 bits: tag
+	std::atomic<u64> mHead;
+	std::atomic<s32> mUsed = 0;
+	std::atomic<s32> mHighWater = 0;
+	// index + 1 of the free slot after each free slot
+	std::atomic<u32> mNext[SlotNum];
+	uintptr_t mStorage[SlotNum][cStride / sizeof(uintptr_t)];
+
+	void* alloc() {
+		u64 head = mHead.load(std::memory_order_acquire);
+		while (true) {
+			const u32 index = u32(head);
+			if (index == 0) return nullptr;
+
+			const u64 next = ((head & ~u64(0xFFFFFFFF)) + cTagOne) | mNext[index - 1].load(std::memory_order_relaxed);
+			if (mHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+				const s32 used = mUsed.fetch_add(1, std::memory_order_relaxed) + 1;
+				s32 highWater = mHighWater.load(std::memory_order_relaxed);
+				while (used > highWater && !mHighWater.compare_exchange_weak(highWater, used, std::memory_order_relaxed))
+					;
+				return mStorage[index - 1];
+			}
+		}
+	}
+
+	void free(void* ptr) {
+		const u32 index = u32((static_cast<u8*>(ptr) - reinterpret_cast<u8*>(mStorage[0])) / cStride) + 1;
+
+		u64 head = mHead.load(std::memory_order_relaxed);
+		u64 next;
+		do {
+			mNext[index - 1].store(u32(head), std::memory_order_relaxed);
+			next = ((head & ~u64(0xFFFFFFFF)) + cTagOne) | index;
+		} while (!mHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+
+		mUsed.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+public:
+	constexpr static s32 capacity = SlotNum;
+
+	Pool() {
+		for (s32 i = 0; i < SlotNum; i++)
+			mNext[i].store(i + 1 < SlotNum ? i + 2 : 0, std::memory_order_relaxed);
+		mHead.store(1, std::memory_order_release);
+	}
+
+	// returns nullptr if every slot is taken. never blocks
+	template <typename T, typename... Args>
+	T* create(Args&&... args) {
+		static_assert(sizeof(T) <= SlotSize && alignof(T) <= cAlignment, "type doesn't fit in this pool's slots");
+
+		void* slot = alloc();
+		if (!slot) return nullptr;
+		return new (slot) T(std::forward<Args>(args)...);
+	}
+
+	template <typename T>
+	void destroy(T* object) {
+		if (!object) return;
+		object->~T();
+		free(object);
+	}
+
+	s32 getUsed() const { return mUsed.load(std::memory_order_relaxed); }
+
+	// the most slots that have ever been taken at once
+	s32 getHighWater() const { return mHighWater.load(std::memory_order_relaxed); }
+};
+
+} // namespace cly
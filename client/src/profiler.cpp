@@ -0,0 +1,141 @@
+#include "profiler.h"
+#include "server.h"
+
+namespace cly::profiler {
+
+namespace {
+
+static_assert((cFrameNum & (cFrameNum - 1)) == 0, "profiler window size must be a power of two");
+
+// 5us buckets, so p99 is exact to within 5us up to 640us. anything slower lands in the last bucket
+constexpr s32 cBucketNum = 128;
+constexpr u64 cTicksPerBucket = util::cSystemTickFrequency / 200'000;
+// a summary is sent to the server every this many frames
+constexpr u32 cReportInterval = 600;
+
+constexpr const char* cSeriesNames[cSeriesNum] = {
+	"update", "draw", "scene", "npad", "npadst", "kit", "kitlist", "total",
+};
+
+struct Series {
+	// this frame's total so far
+	u64 frameTicks = 0;
+	// rolling window, addressed by frame number
+	u32 samples[cFrameNum] = {};
+	u16 histogram[cBucketNum] = {};
+	u64 sum = 0;
+};
+
+Series sSeries[cSeriesNum];
+u32 sIntervals[cFrameNum] = {};
+u64 sIntervalSum = 0;
+u64 sLastFrameTick = 0;
+// free-running, only masked when addressing the windows
+u32 sFrameCount = 0;
+
+s32 getBucket(u64 ticks) {
+	u64 bucket = ticks / cTicksPerBucket;
+	return bucket < cBucketNum ? s32(bucket) : cBucketNum - 1;
+}
+
+void push(Series& series, u64 ticks) {
+	u32& sample = series.samples[sFrameCount & (cFrameNum - 1)];
+	// the window is full, so this slot holds the frame from cFrameNum frames ago
+	if (sFrameCount >= u32(cFrameNum)) {
+		series.sum -= sample;
+		series.histogram[getBucket(sample)]--;
+	}
+
+	sample = ticks < 0xFFFFFFFF ? u32(ticks) : 0xFFFFFFFF;
+	series.sum += sample;
+	series.histogram[getBucket(sample)]++;
+}
+
+u32 getSampleNum() {
+	return sFrameCount < u32(cFrameNum) ? sFrameCount : cFrameNum;
+}
+
+void reportToServer() {
+	sead::FixedSafeString<128> text;
+	for (s32 i = 0; i < cSeriesNum; i++) {
+		format(i, &text);
+		Server::log("[profiler] %s", text.cstr());
+	}
+}
+
+} // namespace
+
+void add(Hook hook, u64 ticks) {
+	sSeries[hook].frameTicks += ticks;
+}
+
+void endFrame() {
+	if constexpr (!isEnabled()) return;
+
+	u64 total = 0;
+	for (s32 i = 0; i < cHook_Num; i++) {
+		total += sSeries[i].frameTicks;
+		push(sSeries[i], sSeries[i].frameTicks);
+		sSeries[i].frameTicks = 0;
+	}
+	push(sSeries[cSeries_Total], total);
+
+	const u64 now = util::getSystemTick();
+	u32& interval = sIntervals[sFrameCount & (cFrameNum - 1)];
+	if (sFrameCount >= u32(cFrameNum)) sIntervalSum -= interval;
+	interval = sLastFrameTick != 0 ? u32(now - sLastFrameTick) : 0;
+	sIntervalSum += interval;
+	sLastFrameTick = now;
+
+	sFrameCount++;
+	if (sFrameCount % cReportInterval == 0) reportToServer();
+}
+
+bool getSummary(s32 series, Summary* out) {
+	const u32 sampleNum = getSampleNum();
+	if (sampleNum == 0) return false;
+
+	const Series& s = sSeries[series];
+	out->min = 0xFFFFFFFF;
+	for (u32 i = 0; i < sampleNum; i++)
+		if (s.samples[i] < out->min) out->min = s.samples[i];
+	out->avg = s.sum / sampleNum;
+
+	// walk down from the slowest bucket until more than 1% of the frames have been passed
+	const u32 tail = sampleNum / 100;
+	u32 count = 0;
+	s32 bucket = cBucketNum - 1;
+	for (; bucket > 0; bucket--) {
+		count += s.histogram[bucket];
+		if (count > tail) break;
+	}
+	out->p99 = (bucket + 1) * cTicksPerBucket;
+	return true;
+}
+
+u64 getAvgFrameTicks() {
+	const u32 sampleNum = getSampleNum();
+	return sampleNum != 0 ? sIntervalSum / sampleNum : 0;
+}
+
+void format(s32 series, sead::BufferedSafeString* out) {
+	Summary summary;
+	if (!getSummary(series, &summary)) {
+		out->format("%-7s -", cSeriesNames[series]);
+		return;
+	}
+
+	out->format(
+		"%-7s %4lu %4lu %4lu", cSeriesNames[series], util::ticksToMicroseconds(summary.min), util::ticksToMicroseconds(summary.avg),
+		util::ticksToMicroseconds(summary.p99)
+	);
+
+	// hundredths of a percent of the average frame time
+	const u64 frameTicks = getAvgFrameTicks();
+	if (series == cSeries_Total && frameTicks != 0) {
+		const u64 share = summary.avg * 10000 / frameTicks;
+		out->appendWithFormat(" %lu.%02lu%%", share / 100, share % 100);
+	}
+}
+
+} // namespace cly::profiler
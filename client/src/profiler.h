@@ -0,0 +1,75 @@
+#pragma once
+
+#include "util.h"
+
+#include <hk/types.h>
+
+#include <sead/prim/seadSafeString.h>
+
+// set to 0 to compile every profiler scope away
+#ifndef CLY_PROFILE
+#define CLY_PROFILE 1
+#endif
+
+namespace cly::profiler {
+
+// every hook that does work of its own. only that work is timed, never the game's function the hook wraps
+enum Hook : s32 {
+	cHook_GameSystemUpdate,
+	cHook_GameSystemDraw,
+	cHook_SceneMovement,
+	cHook_NpadControllerCalc,
+	cHook_GetNpadStates,
+	cHook_DrawKit,
+	cHook_DrawKitList,
+
+	cHook_Num,
+};
+
+// one series per hook, plus the sum of all of them
+constexpr s32 cSeries_Total = cHook_Num;
+constexpr s32 cSeriesNum = cHook_Num + 1;
+
+constexpr bool isEnabled() {
+	return CLY_PROFILE != 0;
+}
+
+void add(Hook hook, u64 ticks);
+
+// adds the time spent in the enclosing block to the hook's total for the current frame.
+// all hooks run on the main thread, as does endFrame, so no synchronisation is needed
+class Scope {
+	Hook mHook;
+	u64 mStart = 0;
+
+public:
+	Scope(Hook hook) : mHook(hook) {
+		if constexpr (isEnabled()) mStart = util::getSystemTick();
+	}
+
+	~Scope() {
+		if constexpr (isEnabled()) add(mHook, util::getSystemTick() - mStart);
+	}
+};
+
+// per-frame totals over the last cFrameNum frames, in ticks
+struct Summary {
+	u64 min;
+	u64 avg;
+	// rounded up to the histogram's bucket size
+	u64 p99;
+};
+
+constexpr s32 cFrameNum = 256;
+
+// closes the current frame: each hook's total for it goes into that hook's rolling window
+void endFrame();
+
+// returns false until at least one frame has ended
+bool getSummary(s32 series, Summary* out);
+// average time between two endFrame calls, in ticks
+u64 getAvgFrameTicks();
+
+void format(s32 series, sead::BufferedSafeString* out);
+
+} // namespace cly::profiler
@@ -0,0 +1,136 @@
+#include "recorder.h"
+#include "menu.h"
+
+#include <cstring>
+
+#include <sead/controller/seadAccelerometerAddon.h>
+
+namespace cly::tas {
+
+SEAD_SINGLETON_DISPOSER_IMPL(Recorder);
+
+namespace {
+
+// everything in a FramePacket but its indices
+bool isSameInput(const Server::FramePacket& a, const Server::FramePacket& b) {
+	constexpr size_t cInputOffset = offsetof(Server::FramePacket, player1);
+	return memcmp(cast<const u8*>(&a) + cInputOffset, cast<const u8*>(&b) + cInputOffset, sizeof(Server::FramePacket) - cInputOffset) == 0;
+}
+
+u8 getControllerType(const al::NpadController* controller) {
+	u32 styleTag = u32(controller->mNpadStyleTag);
+	return styleTag != 0 ? u8(__builtin_ctz(styleTag) + 1) : System::cControllerType_None;
+}
+
+} // namespace
+
+void Recorder::start() {
+	Recorder* self = instance();
+	if (self->mIsRecording) return;
+
+	if (System::isReplaying()) {
+		Menu::log("can't record while replaying");
+		return;
+	}
+
+	// controller types and the frame count are only known once recording stops
+	self->mScriptInfo = {};
+	self->mScriptInfo.playerCount = 1;
+	if (ScriptCache::instance()->beginRecording(cFilePath, self->mScriptInfo).failed()) {
+		Menu::log("can't record right now");
+		return;
+	}
+
+	memset(&self->mFrame, 0, sizeof(self->mFrame));
+	self->mFrameIdx = 0;
+	self->mSpanCount = 0;
+	self->mBlock = nullptr;
+	self->mIsFailed = false;
+	self->mIsRecording = true;
+	Menu::log("started recording");
+}
+
+void Recorder::stop() {
+	Recorder* self = instance();
+	if (!self->mIsRecording) return;
+	self->mIsRecording = false;
+
+	// the last span ends where the recording does, rather than being held for a single frame
+	if (self->mFrameIdx > 0 && !self->mIsFailed) self->pushSpan(self->mFrameIdx);
+	self->flushBlock();
+
+	// the cache thread finishes the file, with the frame count of whatever it managed to write
+	ScriptCache::instance()->endRecording(self->mScriptInfo);
+	Menu::log("recorded %d frames in %d spans", self->mFrameIdx, self->mSpanCount);
+}
+
+void Recorder::capture(s32 player, const System::InjectTarget& target) {
+	Recorder* self = instance();
+	const al::NpadController* controller = target.controller;
+
+	Server::Controller& state = player == 0 ? self->mFrame.player1 : self->mFrame.player2;
+	state.buttons = convertButtonsSeadToSTAS(controller->mPadHold).getDirect();
+	state.leftStick = { s32(controller->mLeftStick.x * 32767.f), s32(controller->mLeftStick.y * 32767.f) };
+	state.rightStick = { s32(controller->mRightStick.x * 32767.f), s32(controller->mRightStick.y * 32767.f) };
+	if (target.accel[0]) state.accelLeft = target.accel[0]->mAcceleration;
+	if (target.accel[1]) state.accelRight = target.accel[1]->mAcceleration;
+
+	self->mScriptInfo.controllerTypes[player] = getControllerType(controller);
+	if (player + 1 > self->mScriptInfo.playerCount) self->mScriptInfo.playerCount = player + 1;
+}
+
+void Recorder::endFrame() {
+	Recorder* self = instance();
+	if (!self->mIsRecording) return;
+
+	// the server can start a replay at any time, which takes the controllers over
+	if (System::isReplaying()) {
+		stop();
+		return;
+	}
+
+	if (self->mIsFailed || ScriptCache::instance()->isRecordFailed()) {
+		Menu::log("recording stopped early, it ends at the last block written");
+		stop();
+		return;
+	}
+
+	if (self->mFrameIdx == 0 || !isSameInput(self->mSpan, self->mFrame)) {
+		if (self->mFrameIdx > 0) self->pushSpan(self->mFrameIdx);
+		self->mSpan = self->mFrame;
+		self->mSpan.frameIndex = self->mFrameIdx;
+	}
+
+	self->mFrameIdx++;
+}
+
+void Recorder::pushSpan(u32 nextFrameIndex) {
+	mSpan.nextFrameIndex = nextFrameIndex;
+	mSpan.serverIndex = mSpanCount;
+
+	if (!mBlock) {
+		// the cache thread is a whole ring of blocks behind. a span can't be skipped, so the recording ends before it
+		mBlock = ScriptCache::instance()->beginRecordBlock();
+		if (!mBlock) {
+			mIsFailed = true;
+			return;
+		}
+		mEncoder.init(mBlock->data, sizeof(mBlock->data), mSpan.serverIndex, mSpan.frameIndex);
+	}
+
+	// a block is sized to always fit cChunkFrameNum records
+	mEncoder.push(mSpan);
+	mSpanCount++;
+
+	if (mEncoder.getCount() >= ScriptCache::cChunkFrameNum) flushBlock();
+}
+
+void Recorder::flushBlock() {
+	if (!mBlock) return;
+
+	mBlock->size = mEncoder.finish();
+	mBlock = nullptr;
+	ScriptCache::instance()->endRecordBlock();
+}
+
+} // namespace cly::tas
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "framedelta.h"
+#include "scriptcache.h"
+#include "server.h"
+#include "tas.h"
+
+#include <hk/types.h>
+
+#include <sead/heap/seadDisposer.h>
+
+namespace cly::tas {
+
+// records the live controller state into a script file in the cache's layout (see scriptcache.h),
+// so a recording plays back exactly like a cached script without anything going over the network.
+// each run of frames with identical inputs becomes a single span, and spans are delta encoded straight into one of
+// ScriptCache's recording blocks. once a block holds ScriptCache::cChunkFrameNum spans it's handed to the cache thread to write out
+class Recorder {
+	SEAD_SINGLETON_DISPOSER(Recorder);
+
+public:
+	constexpr static const char* cFilePath = "sd:/calypso_recording.bin";
+
+private:
+	bool mIsRecording = false;
+	// set when there was nowhere to put a span. the recording stops at the end of the frame
+	bool mIsFailed = false;
+	Server::ScriptInfoPacket mScriptInfo;
+
+	// filled in by capture while the frame runs, only the controller fields are used
+	Server::FramePacket mFrame;
+	// the span currently being held. its frameIndex is the frame it started on
+	Server::FramePacket mSpan;
+	u32 mFrameIdx = 0;
+	u32 mSpanCount = 0;
+
+	framedelta::Encoder mEncoder;
+	// the block being encoded into, owned by ScriptCache
+	ScriptCache::Block* mBlock = nullptr;
+
+	void pushSpan(u32 nextFrameIndex);
+	void flushBlock();
+
+public:
+	Recorder() = default;
+
+	static bool isRecording() { return instance()->mIsRecording; }
+
+	static void start();
+	static void stop();
+	static void toggle() { isRecording() ? stop() : start(); }
+
+	// takes a player's state for the current frame from their controller. called once per controller per frame
+	static void capture(s32 player, const System::InjectTarget& target);
+	// closes the current frame. identical frames extend the current span, anything else starts a new one
+	static void endFrame();
+};
+
+} // namespace cly::tas
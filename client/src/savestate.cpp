@@ -0,0 +1,75 @@
+#include "savestate.h"
+#include "menu.h"
+#include "tas.h"
+
+#include "Library/Camera/CameraUtil.h"
+#include "Library/LiveActor/ActorPoseUtil.h"
+#include "Library/LiveActor/LiveActor.h"
+#include "Library/Nerve/NerveUtil.h"
+#include "Library/Scene/Scene.h"
+
+#include "Scene/StageScene.h"
+
+namespace cly {
+
+SEAD_SINGLETON_DISPOSER_IMPL(SaveStates);
+
+void SaveStates::capture(const al::Scene* scene, const al::LiveActor* actor, Snapshot* out) {
+	out->isValid = true;
+	out->frameIndex = tas::System::getFrameIndex();
+	out->trans = al::getTrans(actor);
+	out->quat = al::getQuat(actor);
+	out->velocity = al::getVelocity(actor);
+	out->gravity = al::getGravity(actor);
+	out->nerve = al::getCurrentNerve(actor);
+	out->cameraTarget = al::getCameraTarget(scene);
+}
+
+void SaveStates::apply(const al::Scene* scene, al::LiveActor* actor, const Snapshot& snapshot) {
+	al::setTrans(actor, snapshot.trans);
+	al::setQuat(actor, snapshot.quat);
+	al::setVelocity(actor, snapshot.velocity);
+	al::setGravity(actor, snapshot.gravity);
+	// setting the nerve restarts it, even when it's the one the player is already in
+	if (snapshot.nerve) al::setNerve(actor, snapshot.nerve);
+	if (snapshot.cameraTarget) al::setCameraTarget(scene, snapshot.cameraTarget);
+	// the player has jumped, so the camera cuts to them instead of panning over
+	al::requestCancelCameraInterpole(scene, 0);
+}
+
+void SaveStates::update(al::Scene* scene) {
+	SaveStates* self = instance();
+	Request request = self->mRequest.exchange(Request::None);
+	if (request == Request::None) return;
+
+	al::LiveActor* player = rs::getPlayerActor(scene);
+	if (!player) {
+		Menu::log("no player to %s", request == Request::Save ? "save" : "load");
+		return;
+	}
+
+	if (request == Request::Save) {
+		Snapshot& slot = self->mSlots[self->mNextSlot];
+		capture(scene, player, &slot);
+		self->mLastSlot = self->mNextSlot;
+		self->mNextSlot = (self->mNextSlot + 1) % cSlotNum;
+		Menu::log("saved state %d at frame %d", self->mLastSlot, slot.frameIndex);
+		return;
+	}
+
+	if (self->mLastSlot < 0) {
+		Menu::log("no state to load");
+		return;
+	}
+
+	const Snapshot& slot = self->mSlots[self->mLastSlot];
+	apply(scene, player, slot);
+	Menu::log("loaded state %d from frame %d", self->mLastSlot, slot.frameIndex);
+}
+
+void SaveStates::handleSceneInit() {
+	for (Snapshot& slot : instance()->mSlots)
+		slot.cameraTarget = nullptr;
+}
+
+} // namespace cly
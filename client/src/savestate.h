@@ -0,0 +1,73 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <atomic>
+
+#include <sead/heap/seadDisposer.h>
+#include <sead/math/seadQuat.h>
+#include <sead/math/seadVector.h>
+
+namespace al {
+class CameraTargetBase;
+class LiveActor;
+class Nerve;
+class Scene;
+} // namespace al
+
+namespace cly {
+
+// in-memory snapshots of the player's pose and nerve and of what the camera follows, so a segment can be retried
+// without reloading the stage. saving and loading are only requested from the menu, and carried out at the end of the
+// next scene update. the player's states below its nerve, cappy and the camera's own position aren't restored (see todo.txt)
+class SaveStates {
+	SEAD_SINGLETON_DISPOSER(SaveStates);
+
+public:
+	constexpr static s32 cSlotNum = 8;
+
+	struct Snapshot {
+		bool isValid = false;
+		// tas::System's frame index when the snapshot was taken, so it can be matched up with a script
+		u32 frameIndex = 0;
+		sead::Vector3f trans;
+		sead::Quatf quat;
+		sead::Vector3f velocity;
+		sead::Vector3f gravity;
+		// nerves are static singletons, so the pointer stays good across stages
+		const al::Nerve* nerve = nullptr;
+		// owned by the scene, so dropped once the scene it was taken in is gone
+		al::CameraTargetBase* cameraTarget = nullptr;
+	};
+
+private:
+	enum class Request : u8 {
+		None,
+		Save,
+		Load,
+	};
+
+	// all of the snapshots live here, so saving never allocates
+	Snapshot mSlots[cSlotNum];
+	// slot the next save goes into. the oldest snapshot is overwritten once every slot is taken
+	s32 mNextSlot = 0;
+	s32 mLastSlot = -1;
+	std::atomic<Request> mRequest = Request::None;
+
+	static void capture(const al::Scene* scene, const al::LiveActor* actor, Snapshot* out);
+	static void apply(const al::Scene* scene, al::LiveActor* actor, const Snapshot& snapshot);
+
+public:
+	SaveStates() = default;
+
+	static void requestSave() { instance()->mRequest = Request::Save; }
+
+	static void requestLoad() { instance()->mRequest = Request::Load; }
+
+	// carries out a pending request. called from the scene movement hook, once the scene is done updating
+	static void update(al::Scene* scene);
+	// called before a scene is initialised, once the previous scene and its camera targets are gone
+	static void handleSceneInit();
+};
+
+} // namespace cly
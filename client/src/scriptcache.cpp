@@ -0,0 +1,250 @@
+#include "scriptcache.h"
+#include "menu.h"
+#include "tas.h"
+#include "util.h"
+
+#include <hk/diag/diag.h>
+#include <hk/svc/api.h>
+
+#include <cstring>
+
+#include <nn/fs.h>
+#include <sead/heap/seadHeapMgr.h>
+
+namespace cly {
+
+SEAD_SINGLETON_DISPOSER_IMPL(ScriptCache);
+
+// how long the cache thread sleeps while both chunks are full, or while no recorded block is waiting.
+// a chunk or block lasts at least a second of gameplay, so this can be coarse
+constexpr static s64 cRefillPollNs = 4'000'000;
+
+void ScriptCache::init(sead::Heap* heap) {
+	mHeap = heap;
+	sead::ScopedCurrentHeapSetter heapSetter(mHeap);
+
+	al::FunctorV0M functor(this, &ScriptCache::threadMain);
+	mThread = new (mHeap) al::AsyncFunctorThread("Cache Thread", functor, 0, 0x8000, {});
+}
+
+void ScriptCache::threadMain() {
+	if (mJob == Job::Record)
+		threadRecord();
+	else
+		threadRead();
+}
+
+/*
+ * ================ UPLOAD ================
+ */
+
+hk::Result ScriptCache::Writer::begin(const char* path, const Server::ScriptInfoPacket& scriptInfo) {
+	if (mIsWriting) nn::fs::CloseFile(mHandle);
+	mIsWriting = false;
+
+	if (util::createFile(path, 0, true).failed()) return hk::ResultFailed();
+	LOG_R(nn::fs::OpenFile(&mHandle, path, nn::fs::OpenMode_Write | nn::fs::OpenMode_Append));
+
+	memcpy(mHeader.magic, cMagic, sizeof(cMagic));
+	mHeader.version = cVersion;
+	mHeader.scriptInfo = scriptInfo;
+	// only filled in by end, so a partial file is never mistaken for a complete one
+	mHeader.blockCount = 0;
+
+	mIsWriting = true;
+	mOffset = sizeof(FileHeader);
+	mFrameCount = 0;
+	LOG_R(nn::fs::WriteFile(mHandle, 0, &mHeader, sizeof(FileHeader), nn::fs::WriteOption::CreateOption(0)));
+	return hk::ResultSuccess();
+}
+
+hk::Result ScriptCache::Writer::write(const u8* data, u32 size) {
+	if (!mIsWriting) return hk::ResultFailed();
+
+	framedelta::Decoder decoder;
+	if (size > cBlockSizeMax || !decoder.init(data, size) || decoder.getRemaining() == 0 || decoder.getRemaining() > cChunkFrameNum) {
+		Menu::log("dropping invalid cache block");
+		return hk::ResultFailed();
+	}
+
+	LOG_R(nn::fs::WriteFile(mHandle, mOffset, &size, sizeof(size), nn::fs::WriteOption::CreateOption(0)));
+	LOG_R(nn::fs::WriteFile(mHandle, mOffset + sizeof(size), data, size, nn::fs::WriteOption::CreateOption(0)));
+	mOffset += sizeof(size) + size;
+	mHeader.blockCount++;
+	mFrameCount += decoder.getRemaining();
+	return hk::ResultSuccess();
+}
+
+hk::Result ScriptCache::Writer::end() {
+	if (!mIsWriting) return hk::ResultFailed();
+	mIsWriting = false;
+
+	nn::Result result = nn::fs::WriteFile(mHandle, 0, &mHeader, sizeof(FileHeader), nn::fs::WriteOption::CreateOption(nn::fs::WriteOptionFlag_Flush));
+	nn::fs::CloseFile(mHandle);
+	LOG_R(result);
+
+	Menu::log("wrote script: %d frames in %d blocks", mHeader.scriptInfo.frameCount, mHeader.blockCount);
+	return hk::ResultSuccess();
+}
+
+hk::Result ScriptCache::beginWrite(const Server::ScriptInfoPacket& scriptInfo) {
+	if (mIsStreaming || mIsRecording) {
+		Menu::log("can't cache a script while playing from the cache");
+		return hk::ResultFailed();
+	}
+
+	return mWriter.begin(cFilePath, scriptInfo);
+}
+
+hk::Result ScriptCache::writeBlock(const u8* data, u32 size) {
+	return mWriter.write(data, size);
+}
+
+hk::Result ScriptCache::endWrite() {
+	return mWriter.end();
+}
+
+/*
+ * ================ PLAYBACK ================
+ */
+
+bool ScriptCache::startStreaming(Server::ScriptInfoPacket* scriptInfo, const char* path) {
+	// the previous read or recording still has to notice it was stopped and close its file
+	if (mIsStreaming || !mThread->isDone()) return false;
+	if ((strcmp(path, cFilePath) == 0 && mWriter.isWriting()) || !util::isFileExist(path)) return false;
+
+	if (nn::fs::OpenFile(&mReadHandle, path, nn::fs::OpenMode_Read).IsFailure()) return false;
+
+	FileHeader header;
+	if (nn::fs::ReadFile(mReadHandle, 0, &header, sizeof(FileHeader)).IsFailure() || memcmp(header.magic, cMagic, sizeof(cMagic)) != 0 ||
+		header.version != cVersion || header.blockCount == 0) {
+		nn::fs::CloseFile(mReadHandle);
+		return false;
+	}
+
+	*scriptInfo = header.scriptInfo;
+	mReadOffset = sizeof(FileHeader);
+	mBlocksLeft = header.blockCount;
+	mChunkPos = 0;
+	mChunks.clear();
+
+	mIsStreaming = true;
+	mJob = Job::Read;
+	mThread->start();
+	return true;
+}
+
+void ScriptCache::stopStreaming() {
+	// the read thread closes the file on its way out
+	mIsStreaming = false;
+}
+
+void ScriptCache::threadRead() {
+	while (mIsStreaming && mBlocksLeft > 0) {
+		Chunk* chunk = mChunks.beginWrite();
+		if (!chunk) {
+			hk::svc::SleepThread(cRefillPollNs);
+			continue;
+		}
+
+		if (!readNextBlock(chunk)) {
+			// the replay would otherwise sit blocked on the next chunk forever.
+			// the frames already read are fine, so it only stops once they have been played
+			Menu::log("script cache is corrupt, stopping");
+			while (mIsStreaming && mChunks.size() > 0)
+				hk::svc::SleepThread(cRefillPollNs);
+			if (mIsStreaming) tas::System::requestStopReplay();
+			break;
+		}
+
+		mChunks.endWrite();
+		mBlocksLeft--;
+	}
+
+	nn::fs::CloseFile(mReadHandle);
+}
+
+bool ScriptCache::readNextBlock(Chunk* chunk) {
+	u32 size;
+	if (nn::fs::ReadFile(mReadHandle, mReadOffset, &size, sizeof(size)).IsFailure() || size > cBlockSizeMax) return false;
+	if (nn::fs::ReadFile(mReadHandle, mReadOffset + sizeof(size), mBlockBuf, size).IsFailure()) return false;
+	mReadOffset += sizeof(size) + size;
+
+	framedelta::Decoder decoder;
+	if (!decoder.init(mBlockBuf, size)) return false;
+
+	chunk->count = 0;
+	while (chunk->count < cChunkFrameNum && decoder.next(&chunk->frames[chunk->count]))
+		chunk->count++;
+
+	// every frame the block says it holds has to decode. playing on from a partial block would skip the frames it lost
+	return chunk->count > 0 && decoder.getRemaining() == 0;
+}
+
+const Server::FramePacket* ScriptCache::peek() {
+	const Chunk* chunk = mChunks.peek();
+	if (!chunk) return nullptr;
+	return &chunk->frames[mChunkPos];
+}
+
+void ScriptCache::pop() {
+	const Chunk* chunk = mChunks.peek();
+	if (!chunk) return;
+
+	if (++mChunkPos >= chunk->count) {
+		mChunkPos = 0;
+		mChunks.pop();
+	}
+}
+
+/*
+ * ================ RECORDING ================
+ */
+
+hk::Result ScriptCache::beginRecording(const char* path, const Server::ScriptInfoPacket& scriptInfo) {
+	// the thread may still be finishing the last recording or playback
+	if (mIsStreaming || !mThread->isDone()) return hk::ResultFailed();
+
+	if (mRecordWriter.begin(path, scriptInfo).failed()) return hk::ResultFailed();
+
+	mRecordBlocks.clear();
+	mIsRecordFailed = false;
+	mIsRecording = true;
+	mJob = Job::Record;
+	mThread->start();
+	return hk::ResultSuccess();
+}
+
+void ScriptCache::endRecording(const Server::ScriptInfoPacket& scriptInfo) {
+	mRecordScriptInfo = scriptInfo;
+	// publishes mRecordScriptInfo along with it
+	mIsRecording = false;
+}
+
+void ScriptCache::threadRecord() {
+	while (true) {
+		// sampled before looking for a block, so the blocks pushed before endRecording are always written
+		const bool isRecording = mIsRecording;
+
+		const Block* block = mRecordBlocks.peek();
+		if (!block) {
+			if (!isRecording) break;
+			hk::svc::SleepThread(cRefillPollNs);
+			continue;
+		}
+
+		// after a failed write the rest are dropped, so the file stays a valid recording of everything up to that point
+		if (!mIsRecordFailed && mRecordWriter.write(block->data, block->size).failed()) {
+			Menu::log("failed to write recording");
+			mIsRecordFailed = true;
+		}
+		mRecordBlocks.pop();
+	}
+
+	Server::ScriptInfoPacket scriptInfo = mRecordScriptInfo;
+	scriptInfo.frameCount = mRecordWriter.getFrameCount();
+	mRecordWriter.setScriptInfo(scriptInfo);
+	mRecordWriter.end();
+}
+
+} // namespace cly
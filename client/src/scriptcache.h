@@ -0,0 +1,149 @@
+#pragma once
+
+#include "framedelta.h"
+#include "framering.h"
+#include "server.h"
+
+#include <hk/Result.h>
+#include <hk/types.h>
+
+#include <atomic>
+
+#include <nn/fs.h>
+#include <sead/heap/seadDisposer.h>
+
+#include "Library/Thread/AsyncFunctorThread.h"
+
+namespace cly {
+
+// a copy of the current script on the SD card, so a replay can run without the network.
+// the server uploads the script once as a sequence of FrameDelta blocks (see framedelta.h),
+// and during playback the "Cache Thread" decodes it block by block into a pair of chunks that tas::System drains.
+// while recording, the same thread takes the recorder's finished blocks and writes them out, so the game thread never waits on the SD card
+class ScriptCache {
+	SEAD_SINGLETON_DISPOSER(ScriptCache);
+
+public:
+	constexpr static s32 cChunkFrameNum = 64;
+
+private:
+	/*
+	 * file layout:
+	 *   FileHeader
+	 *   for each of blockCount blocks:
+	 *     u32 size
+	 *     FrameDelta packet body of `size` bytes, holding at most cChunkFrameNum frames
+	 */
+	struct FileHeader {
+		char magic[4];
+		u32 version;
+		Server::ScriptInfoPacket scriptInfo;
+		u32 blockCount;
+	};
+
+	struct Chunk {
+		u32 count;
+		Server::FramePacket frames[cChunkFrameNum];
+	};
+
+	constexpr static char cMagic[4] = { 'C', 'L', 'Y', 'C' };
+	// bumped whenever FramePacket's fields change, since blocks are FrameDelta packets
+	constexpr static u32 cVersion = 1;
+
+public:
+	constexpr static const char* cFilePath = "sd:/calypso_script.bin";
+	constexpr static u32 cBlockSizeMax = sizeof(framedelta::Header) + framedelta::cMaxRecordSize * cChunkFrameNum;
+
+	// one encoded block of a recording, on its way to the cache thread
+	struct Block {
+		u32 size;
+		u8 data[cBlockSizeMax];
+	};
+
+	// writes a file in the layout above one block at a time. each writer is only used from one thread
+	class Writer {
+		nn::fs::FileHandle mHandle;
+		bool mIsWriting = false;
+		s64 mOffset = 0;
+		u32 mFrameCount = 0;
+		FileHeader mHeader;
+
+	public:
+		bool isWriting() const { return mIsWriting; }
+
+		// frames in the blocks written so far
+		u32 getFrameCount() const { return mFrameCount; }
+
+		hk::Result begin(const char* path, const Server::ScriptInfoPacket& scriptInfo);
+		hk::Result write(const u8* data, u32 size);
+		// for scripts that aren't fully known until they end. only written out by end
+		void setScriptInfo(const Server::ScriptInfoPacket& scriptInfo) { mHeader.scriptInfo = scriptInfo; }
+		hk::Result end();
+	};
+
+private:
+	// what the cache thread does on its next run
+	enum class Job {
+		Read,
+		Record,
+	};
+
+	// blocks the recorder can get ahead of the SD card by, about four seconds of constantly changing input
+	constexpr static s32 cRecordBlockNum = 4;
+
+	sead::Heap* mHeap = nullptr;
+	al::AsyncFunctorThread* mThread = nullptr;
+	Job mJob = Job::Read;
+
+	// upload, recv thread only
+	Writer mWriter;
+
+	// recording. the game thread fills blocks in place and the cache thread writes them out with mRecordWriter
+	Writer mRecordWriter;
+	FrameRing<Block, cRecordBlockNum> mRecordBlocks;
+	std::atomic_bool mIsRecording = false;
+	std::atomic_bool mIsRecordFailed = false;
+	// the recording's final script info, handed over by endRecording
+	Server::ScriptInfoPacket mRecordScriptInfo;
+
+	// playback. the read thread owns the file handle and the back chunk, the game thread owns the front chunk
+	nn::fs::FileHandle mReadHandle;
+	s64 mReadOffset = 0;
+	u32 mBlocksLeft = 0;
+	std::atomic_bool mIsStreaming = false;
+	FrameRing<Chunk, 2> mChunks;
+	u32 mChunkPos = 0;
+	u8 mBlockBuf[cBlockSizeMax];
+
+	void threadMain();
+	void threadRead();
+	void threadRecord();
+	bool readNextBlock(Chunk* chunk);
+
+public:
+	ScriptCache() = default;
+	void init(sead::Heap* heap);
+
+	hk::Result beginWrite(const Server::ScriptInfoPacket& scriptInfo);
+	hk::Result writeBlock(const u8* data, u32 size);
+	hk::Result endWrite();
+
+	// opens the script file at `path` and starts the read thread. returns false if there is no valid file there
+	bool startStreaming(Server::ScriptInfoPacket* scriptInfo, const char* path = cFilePath);
+	void stopStreaming();
+
+	const Server::FramePacket* peek();
+	void pop();
+
+	// starts a recording at `path` and the cache thread that writes it. game thread only, like everything below
+	hk::Result beginRecording(const char* path, const Server::ScriptInfoPacket& scriptInfo);
+	// the next block to encode into, or nullptr if the cache thread has fallen cRecordBlockNum blocks behind
+	Block* beginRecordBlock() { return mRecordBlocks.beginWrite(); }
+	void endRecordBlock() { mRecordBlocks.endWrite(); }
+	// the cache thread writes out what's left and finishes the file. its frame count is filled in from the blocks written
+	void endRecording(const Server::ScriptInfoPacket& scriptInfo);
+	// set once a block couldn't be written. nothing after it is, so the file still ends cleanly at the last good block
+	bool isRecordFailed() const { return mIsRecordFailed; }
+};
+
+} // namespace cly
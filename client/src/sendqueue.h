@@ -0,0 +1,88 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <atomic>
+
+namespace cly {
+
+// lock-free bounded multi-producer/single-consumer queue of outgoing messages.
+// any thread claims a slot with `beginPush`, fills it in place, then publishes it with `endPush`.
+// the send thread takes published slots in order with `peek` and hands them back with `pop`.
+// each slot carries a sequence number saying whose turn it is, as in Vyukov's bounded MPMC queue
+class SendQueue {
+public:
+	enum class Transport : u8 {
+		TCP,
+		UDP,
+	};
+
+	constexpr static s32 cSlotNum = 64;
+	constexpr static u32 cMessageSizeMax = 0x200;
+
+	struct Slot {
+		// == push index: free for a producer. == push index + 1: published, waiting for the consumer
+		std::atomic<u32> seq;
+		Transport transport;
+		u32 size;
+		u8 data[cMessageSizeMax];
+	};
+
+private:
+	static_assert((cSlotNum & (cSlotNum - 1)) == 0, "SendQueue slot count must be a power of two");
+
+	constexpr static u32 cIndexMask = cSlotNum - 1;
+	constexpr static s32 cCacheLineSize = 64;
+
+	// shared by every producer
+	std::atomic<u32> mPushIdx = 0;
+	u8 mProducerPadding[cCacheLineSize];
+
+	// consumer-owned
+	u32 mPopIdx = 0;
+	u8 mConsumerPadding[cCacheLineSize];
+
+	Slot mSlots[cSlotNum];
+
+public:
+	SendQueue() {
+		for (s32 i = 0; i < cSlotNum; i++)
+			mSlots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	/* producers */
+
+	// returns nullptr if the queue is full. never blocks
+	Slot* beginPush() {
+		u32 pos = mPushIdx.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = mSlots[pos & cIndexMask];
+			const s32 diff = s32(slot.seq.load(std::memory_order_acquire) - pos);
+			if (diff == 0) {
+				if (mPushIdx.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot;
+			} else if (diff < 0) {
+				return nullptr;
+			} else {
+				pos = mPushIdx.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void endPush(Slot* slot) { slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	/* consumer */
+
+	// returns nullptr if the next slot hasn't been published yet
+	const Slot* peek() {
+		const Slot& slot = mSlots[mPopIdx & cIndexMask];
+		if (slot.seq.load(std::memory_order_acquire) != mPopIdx + 1) return nullptr;
+		return &slot;
+	}
+
+	void pop() {
+		mSlots[mPopIdx & cIndexMask].seq.store(mPopIdx + cSlotNum, std::memory_order_release);
+		mPopIdx++;
+	}
+};
+
+} // namespace cly
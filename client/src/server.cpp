@@ -1,6 +1,9 @@
 #include "server.h"
+#include "framedelta.h"
 #include "menu.h"
+#include "scriptcache.h"
 #include "tas.h"
+#include "util.h"
 
 #include <hk/container/Array.h>
 #include <hk/diag/diag.h>
@@ -8,10 +11,13 @@
 #include <hk/svc/api.h>
 #include <hk/types.h>
 
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 
 #include <nn/err.h>
 #include <nn/fs.h>
@@ -67,6 +73,8 @@ void Server::init(sead::Heap* heap) {
 
 	al::FunctorV0M functor(this, &Server::threadRecv);
 	mRecvThread = new (mHeap) al::AsyncFunctorThread("Recv Thread", functor, 0, 0x20000, {});
+	al::FunctorV0M sendFunctor(this, &Server::threadSend);
+	mSendThread = new (mHeap) al::AsyncFunctorThread("Send Thread", sendFunctor, 0, 0x8000, {});
 
 	disableSocketInit.installAtSym<"_ZN2nn6socket10InitializeEPvmmi">();
 
@@ -86,6 +94,10 @@ void Server::init(sead::Heap* heap) {
 	}
 
 	HK_ABORT_UNLESS(nn::socket::Bind(mUDPSockFd, (sockaddr*)&serverAddr, sizeof(serverAddr)) >= 0, "failed to bind UDP socket");
+
+	// runs for the whole session, since it also listens for discovery replies while disconnected
+	mRecvThread->start();
+	mSendThread->start();
 }
 
 s32 Server::recvAll(u8* recvBuf, s32 remaining) {
@@ -109,78 +121,254 @@ s32 Server::recvAll(u8* recvBuf, s32 remaining) {
 
 void Server::threadRecv() {
 	while (true) {
-		hk::Result r = handlePacket();
-		if (r.failed()) disconnect();
-		hk::svc::SleepThread(-2);
+		// the connection is set up and torn down here and nowhere else. a lost connection or a connect request
+		// from another thread is picked up within one poll timeout
+		if (mState == State::Lost) disconnect();
+		if (mIsConnectRequested.exchange(false)) {
+			const s32 r = connect();
+			if (r != 0) Menu::log("Connection error: %s", strerror(r));
+		}
+
+		const bool isConnected = mState == State::Connected;
+
+		pollfd fds[2] = {
+			{ .fd = mUDPSockFd, .events = POLLIN, .revents = 0 },
+			{ .fd = mTCPSockFd, .events = POLLIN, .revents = 0 },
+		};
+		s32 r = nn::socket::Poll(fds, isConnected ? 2 : 1, cPollTimeoutMs);
+		if (r < 0) {
+			// most likely the TCP socket failed. back off instead of spinning on the error
+			hk::svc::SleepThread(s64(cPollTimeoutMs) * 1'000'000);
+			continue;
+		}
+		if (r == 0) continue;
+
+		if (fds[0].revents & POLLIN) handleDiscoveryReply();
+
+		if (isConnected && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			hk::Result result = handlePacket();
+			if (result.failed()) disconnect();
+		}
 	}
 }
 
-hk::Result Server::handlePacket() {
-	if (mState != State::Connected) return hk::ResultSuccess();
+u32 Server::getMaxBodySize(PacketHeader::PacketType type) {
+	// every bounded body has to fit in mRecvBuf with room left over for a null terminator
+	static_assert(sizeof(ScriptInfoPacket) < cRecvBufSize);
+	static_assert(sizeof(StartScriptPacket) < cRecvBufSize);
+	static_assert(sizeof(ChangeStagePacket) + cStageNameLenMax * 2 < cRecvBufSize);
+	static_assert(sizeof(UpdateToolPacket) < cRecvBufSize);
+	static_assert(sizeof(framedelta::Header) + framedelta::cMaxRecordSize * FrameBuffer::capacity < cRecvBufSize);
+	static_assert(ScriptCache::cBlockSizeMax < cRecvBufSize);
+
+	switch (type) {
+	case PacketHeader::cPacketType_Frame: return sizeof(FramePacket);
+	case PacketHeader::cPacketType_ScriptInfo: return sizeof(ScriptInfoPacket);
+	case PacketHeader::cPacketType_StartScript: return sizeof(StartScriptPacket);
+	case PacketHeader::cPacketType_Desync: return sizeof(DesyncPacket);
+	case PacketHeader::cPacketType_ChangeStage: return sizeof(ChangeStagePacket) + cStageNameLenMax * 2;
+	case PacketHeader::cPacketType_UpdateTool: return sizeof(UpdateToolPacket);
+	case PacketHeader::cPacketType_FrameDelta: return sizeof(framedelta::Header) + framedelta::cMaxRecordSize * FrameBuffer::capacity;
+	case PacketHeader::cPacketType_CacheBegin: return sizeof(ScriptInfoPacket);
+	case PacketHeader::cPacketType_CacheBlock: return ScriptCache::cBlockSizeMax;
+	default: return 0;
+	}
+}
 
-	// Menu::log("checking for TCP packet...");
+hk::Result Server::discardAll(u32 size) {
+	while (size > 0) {
+		u32 chunk = size < cRecvBufSize ? size : cRecvBufSize;
+		if (recvAll(mRecvBuf, chunk) <= 0) return hk::ResultFailed();
+		size -= chunk;
+	}
 
-	PacketHeader header;
-	if (recvAll((u8*)&header, sizeof(PacketHeader)) <= 0) return hk::ResultFailed();
+	return hk::ResultSuccess();
+}
 
-	// Menu::log("received TCP packet: type %d, size %#x", header.type, header.size);
+hk::Result Server::handleFramePacket(u32 size) {
+	if (size != sizeof(FramePacket)) {
+		Menu::log("dropping frame packet of size %#x", size);
+		return discardAll(size);
+	}
 
-	u8 body[header.size];
-	if (header.size > 0 && recvAll(body, header.size) <= 0) return hk::ResultFailed();
+	if (isWaitingOnReplayStart()) return discardAll(size);
+	if (!tas::System::isReplaying() || tas::System::isPlayingFromCache()) {
+		reportScriptCompleted();
+		return discardAll(size);
+	}
 
-	switch (header.type) {
-	case PacketHeader::cPacketType_Frame: {
-		FramePacket& frame = *cast<FramePacket*>(body);
-		if (!tas::System::isReplaying()) {
-			reportScriptCompleted();
+	bool isFull;
+	return recvFrame(&isFull);
+}
+
+hk::Result Server::handleFrameBatchPacket(u32 size) {
+	if (size == 0 || size % sizeof(FramePacket) != 0 || size / sizeof(FramePacket) > u32(FrameBuffer::capacity)) {
+		Menu::log("dropping frame batch of size %#x", size);
+		return discardAll(size);
+	}
+
+	if (isWaitingOnReplayStart()) return discardAll(size);
+	if (!tas::System::isReplaying() || tas::System::isPlayingFromCache()) {
+		reportScriptCompleted();
+		return discardAll(size);
+	}
+
+	for (u32 remaining = size / sizeof(FramePacket); remaining > 0; remaining--) {
+		bool isFull;
+		if (recvFrame(&isFull).failed()) return hk::ResultFailed();
+		if (isFull) return discardAll((remaining - 1) * sizeof(FramePacket));
+	}
+
+	return hk::ResultSuccess();
+}
+
+hk::Result Server::handleFrameDeltaPacket(u32 size) {
+	if (size < sizeof(framedelta::Header) || size > getMaxBodySize(PacketHeader::cPacketType_FrameDelta)) {
+		Menu::log("dropping frame delta of size %#x", size);
+		return discardAll(size);
+	}
+
+	if (recvAll(mRecvBuf, size) <= 0) return hk::ResultFailed();
+
+	if (isWaitingOnReplayStart()) return hk::ResultSuccess();
+	if (!tas::System::isReplaying() || tas::System::isPlayingFromCache()) {
+		reportScriptCompleted();
+		return hk::ResultSuccess();
+	}
+
+	framedelta::Decoder decoder;
+	if (!decoder.init(mRecvBuf, size)) return hk::ResultSuccess();
+
+	while (decoder.getRemaining() > 0) {
+		// decode straight into the frame's slot. frames that aren't wanted still have to be decoded,
+		// since every record is relative to the one before it
+		const u32 serverIndex = decoder.getNextServerIndex();
+		bool isFull;
+		FramePacket* slot = mFrameBuffer.beginWrite(serverIndex, &isFull);
+		if (isFull) {
+			sendBackOff(serverIndex);
 			break;
 		}
 
-		// Menu::log("frame %d %d", mFrameBuffer.count, mFrameBuffer.capacity);
-		if (mFrameBuffer.count == mFrameBuffer.capacity) {
-			// full! tell server to back off
+		FramePacket scratch;
+		if (!decoder.next(slot ? slot : &scratch)) {
+			Menu::log("malformed frame delta packet");
+			break;
+		}
+		if (slot) mFrameBuffer.endWrite(serverIndex);
+	}
+
+	return hk::ResultSuccess();
+}
 
-			struct [[gnu::packed]] {
-				PacketHeader header;
-				u32 serverIndex;
-			} message = {
-				.header = { .type = PacketHeader::cPacketType_FullFrameBuffer, .size = 4 },
-				.serverIndex = tas::System::getServerIndex(),
-			};
+bool Server::isWaitingOnReplayStart() {
+	// a new replay's frame buffer is reset on the game thread, and until then its frames have nowhere to go.
+	// none of them can have been stored yet, so the server is sent back to the first one
+	if (!tas::System::isStartPending()) return false;
 
-			sendTCPMessage(message);
-		} else {
-			mFrameBuffer.push(frame);
+	sendBackOff(0);
+	return true;
+}
 
-			// Menu::log("frame buffer: %d/%d", mFrameBuffer.count, mFrameBuffer.capacity);
-		}
+hk::Result Server::recvFrame(bool* isFull) {
+	// only the fixed prefix is needed to find the frame's slot. the rest of the frame is received straight into it
+	constexpr u32 cPrefixSize = offsetof(FramePacket, player1);
+	u8 prefix[cPrefixSize];
+	if (recvAll(prefix, cPrefixSize) <= 0) return hk::ResultFailed();
 
-		break;
+	u32 serverIndex;
+	memcpy(&serverIndex, prefix + offsetof(FramePacket, serverIndex), sizeof(serverIndex));
+
+	FramePacket* slot = mFrameBuffer.beginWrite(serverIndex, isFull);
+	if (*isFull) sendBackOff(serverIndex);
+	// already played, already buffered or too far ahead
+	if (!slot) return discardAll(sizeof(FramePacket) - cPrefixSize);
+
+	memcpy(slot, prefix, cPrefixSize);
+	if (recvAll(cast<u8*>(slot) + cPrefixSize, sizeof(FramePacket) - cPrefixSize) <= 0) return hk::ResultFailed();
+	mFrameBuffer.endWrite(serverIndex);
+	return hk::ResultSuccess();
+}
+
+void Server::sendBackOff(u32 serverIndex) {
+	// full! the server is meant to stay within the credit advertised in telemetry,
+	// so this only happens if it ignores it. tell it to back off and resend from the first frame that didn't fit
+
+	struct [[gnu::packed]] {
+		PacketHeader header;
+		u32 serverIndex;
+	} message = {
+		.header = { .type = PacketHeader::cPacketType_FullFrameBuffer, .size = 4 },
+		.serverIndex = serverIndex,
+	};
+
+	sendTCPMessage(message);
+}
+
+hk::Result Server::handlePacket() {
+	if (mState != State::Connected) return hk::ResultSuccess();
+
+	// Menu::log("checking for TCP packet...");
+
+	PacketHeader header;
+	if (recvAll((u8*)&header, sizeof(PacketHeader)) <= 0) return hk::ResultFailed();
+
+	// Menu::log("received TCP packet: type %d, size %#x", header.type, header.size);
+
+	if (header.type == PacketHeader::cPacketType_Frame) return handleFramePacket(header.size);
+	if (header.type == PacketHeader::cPacketType_FrameBatch) return handleFrameBatchPacket(header.size);
+	if (header.type == PacketHeader::cPacketType_FrameDelta) return handleFrameDeltaPacket(header.size);
+
+	if (header.size > getMaxBodySize(header.type)) {
+		Menu::log("dropping packet: type %d, size %#x", header.type, header.size);
+		return discardAll(header.size);
 	}
+
+	u8* body = mRecvBuf;
+	if (header.size > 0 && recvAll(body, header.size) <= 0) return hk::ResultFailed();
+
+	switch (header.type) {
 	case PacketHeader::cPacketType_ScriptInfo:
+		if (header.size != sizeof(ScriptInfoPacket)) break;
 		Menu::log("got script!");
-		mFrameBuffer.clear();
 		tas::System::setScriptInfo(*cast<ScriptInfoPacket*>(body));
 		break;
-	case PacketHeader::cPacketType_StartScript: tas::System::startReplay(); break;
-	case PacketHeader::cPacketType_StopScript: tas::System::stopReplay(); break;
+	case PacketHeader::cPacketType_CacheBegin:
+		if (header.size != sizeof(ScriptInfoPacket)) break;
+		ScriptCache::instance()->beginWrite(*cast<ScriptInfoPacket*>(body));
+		break;
+	case PacketHeader::cPacketType_CacheBlock: ScriptCache::instance()->writeBlock(body, header.size); break;
+	case PacketHeader::cPacketType_CacheEnd: ScriptCache::instance()->endWrite(); break;
+	case PacketHeader::cPacketType_StartCachedScript: tas::System::requestStartCachedReplay(); break;
+	case PacketHeader::cPacketType_StartScript: {
+		if (header.size < sizeof(StartScriptPacket)) break;
+		tas::System::requestStartReplay(cast<StartScriptPacket*>(body)->replayId);
+		break;
+	}
+	case PacketHeader::cPacketType_StopScript: tas::System::requestStopReplay(); break;
 	case PacketHeader::cPacketType_PauseGame: tas::Pauser::instance()->togglePause(); break;
 	case PacketHeader::cPacketType_AdvanceFrame: tas::Pauser::instance()->advanceFrame(); break;
+	case PacketHeader::cPacketType_Desync: {
+		if (header.size < sizeof(DesyncPacket)) break;
+		// not togglePause, the game may already be paused by the time this arrives
+		tas::Pauser::instance()->pause();
+		Menu::log("desync at frame %d", cast<DesyncPacket*>(body)->frameIndex);
+		break;
+	}
 	case PacketHeader::cPacketType_ChangeStage: {
 		Server::log("more logging");
 
-		struct [[gnu::packed]] Start {
-			s32 scenario;
-			u8 subScenario;
-			bool isReturn;
-			u16 stageNameSize;
-			u16 entranceNameSize;
-		};
+		if (header.size < sizeof(ChangeStagePacket)) break;
+		ChangeStagePacket* start = cast<ChangeStagePacket*>(body);
+		if (start->stageNameSize > cStageNameLenMax || start->entranceNameSize > cStageNameLenMax) break;
+		if (sizeof(ChangeStagePacket) + start->stageNameSize + start->entranceNameSize > header.size) break;
 
-		Start* start = cast<Start*>(body);
 		Server::log("%d %d %d %d", start->scenario, start->stageNameSize, start->isReturn, start->subScenario);
-		char* stageName = cast<char*>(body + sizeof(Start));
+		// make sure both names are terminated even if the server didn't send the null terminators
+		body[header.size] = '\0';
+		char* stageName = cast<char*>(body + sizeof(ChangeStagePacket));
 		char* entranceName = cast<char*>(stageName + start->stageNameSize);
+		if (start->stageNameSize > 0) stageName[start->stageNameSize - 1] = '\0';
 		Server::log("%s %s", stageName, entranceName);
 		changeStageInfo.mStageName = stageName;
 		changeStageInfo.mEntranceName = entranceName;
@@ -193,17 +381,24 @@ hk::Result Server::handlePacket() {
 		break;
 	}
 	case PacketHeader::cPacketType_ReloadStage: {
-		// not currently implemented properly
-		// changeStageInfo.mSimpleReload = true;
-		// changeStageInfo.mHasChangeStageInfo = true;
+		changeStageInfo.mSimpleReload = true;
+		changeStageInfo.mHasChangeStageInfo = true;
+		tas::Pauser::instance()->setWaitingOnLoad(true);
 		break;
 	}
 	case PacketHeader::cPacketType_UpdateTool: {
+		if (header.size < 2) break;
 		UpdateToolPacket* start = cast<UpdateToolPacket*>(body);
 		Menu::log("%d %d", start->toolType, start->data[0]);
 		switch (start->toolType) {
 		case UpdateToolPacket::ToolType::ShowUI: tools.showUi = bool(start->data[0]); break;
 		case UpdateToolPacket::ToolType::AlwaysUncollectedMoons: tools.alwaysUncollectedMoons = bool(start->data[0]); break;
+		case UpdateToolPacket::ToolType::TelemetryBatch: {
+			s32 batch = start->data[0];
+			tools.telemetryBatch = batch < 1 ? 1 : batch > cTelemetryBatchMax ? cTelemetryBatchMax : batch;
+			break;
+		}
+		case UpdateToolPacket::ToolType::FastForward: tas::Pauser::instance()->setFastForward(start->data[0]); break;
 		}
 		break;
 	}
@@ -213,37 +408,73 @@ hk::Result Server::handlePacket() {
 	return hk::ResultSuccess();
 }
 
-bool Server::sendTCPMessage(hk::Span<const u8> data) {
-	s32 r = nn::socket::Send(mTCPSockFd, data.data(), data.size_bytes(), 0);
-	if (r < 0) disconnect();
-	return r >= 0;
+void Server::threadSend() {
+	while (true) {
+		u32 batchSize = 0;
+		while (const SendQueue::Slot* slot = mSendQueue.peek()) {
+			if (slot->transport == SendQueue::Transport::UDP) {
+				if (mState == State::Connected) {
+					sockaddr_in serverAddr;
+					serverAddr.sin_addr = mServerIP;
+					serverAddr.sin_family = nn::socket::InetHtons(AF_INET);
+					serverAddr.sin_port = nn::socket::InetHtons(cPort);
+					nn::socket::SendTo(mUDPSockFd, slot->data, slot->size, 0, (sockaddr*)&serverAddr, sizeof(serverAddr));
+				}
+			} else {
+				if (batchSize + slot->size > cSendBatchSize) {
+					flushTCP(batchSize);
+					batchSize = 0;
+				}
+				memcpy(mSendBuf + batchSize, slot->data, slot->size);
+				batchSize += slot->size;
+			}
+			mSendQueue.pop();
+		}
+
+		if (batchSize > 0) flushTCP(batchSize);
+		hk::svc::SleepThread(cSendPollNs);
+	}
 }
 
-s32 Server::sendUDPDatagram(Server::PacketHeader::PacketType type, hk::Span<const u8> data) {
-	if (mState != State::Connected) return 0;
+void Server::flushTCP(u32 size) {
+	// anything queued before a disconnect is stale, drop it
+	if (mState != State::Connected) return;
 
-	sockaddr_in serverAddr;
-	serverAddr.sin_addr = mServerIP;
-	serverAddr.sin_family = nn::socket::InetHtons(AF_INET);
-	serverAddr.sin_port = nn::socket::InetHtons(cPort);
+	s32 r = nn::socket::Send(mTCPSockFd, mSendBuf, size, 0);
+	if (r < 0) {
+		// the recv thread owns the socket, so it's left to that to close it and stop the replay
+		State connected = State::Connected;
+		mState.compare_exchange_strong(connected, State::Lost);
+	}
+}
 
-	struct [[gnu::packed]] {
-		PacketHeader header;
-		hk::Array<u8, 500> data;
-	} message = {
-		.header = { .type = type, .size = u32(data.size_bytes()) },
-	};
+bool Server::pushMessage(SendQueue::Transport transport, PacketHeader::PacketType type, hk::Span<const u8> data) {
+	if (sizeof(PacketHeader) + data.size_bytes() > SendQueue::cMessageSizeMax) return false;
 
-	memcpy(message.data.data(), data.data(), data.size_bytes());
+	SendQueue::Slot* slot = mSendQueue.beginPush();
+	if (!slot) return false;
 
-	s32 r = nn::socket::SendTo(mUDPSockFd, &message, sizeof(PacketHeader) + message.header.size, 0, (sockaddr*)&serverAddr, sizeof(serverAddr));
+	PacketHeader header = { .type = type, .size = u32(data.size_bytes()) };
+	memcpy(slot->data, &header, sizeof(PacketHeader));
+	memcpy(slot->data + sizeof(PacketHeader), data.data(), data.size_bytes());
+	slot->transport = transport;
+	slot->size = sizeof(PacketHeader) + data.size_bytes();
+	mSendQueue.endPush(slot);
+	return true;
+}
 
-	if (r < 0) {
-		disconnect();
-		return nn::socket::GetLastErrno();
-	}
+bool Server::sendTCPMessage(hk::Span<const u8> data) {
+	if (mState != State::Connected || data.size_bytes() < sizeof(PacketHeader)) return false;
 
-	return 0;
+	PacketHeader header;
+	memcpy(&header, data.data(), sizeof(PacketHeader));
+	return pushMessage(SendQueue::Transport::TCP, header.type, { data.data() + sizeof(PacketHeader), data.size_bytes() - sizeof(PacketHeader) });
+}
+
+bool Server::sendUDPDatagram(Server::PacketHeader::PacketType type, hk::Span<const u8> data) {
+	if (mState != State::Connected) return false;
+
+	return pushMessage(SendQueue::Transport::UDP, type, data);
 }
 
 void Server::sendUDPDiscoveryBroadcast() {
@@ -261,11 +492,19 @@ void Server::sendUDPDiscoveryBroadcast() {
 	// todo: assertion crashes switch on sleep, look for relevant errno
 	// HK_ABORT_UNLESS(r >= 0, "failed to send udp broadcast");
 
+	// the reply is picked up by the recv thread in handleDiscoveryReply
+}
+
+void Server::handleDiscoveryReply() {
+	PacketHeader message;
+	sockaddr_in serverAddr;
 	serverAddr.sin_addr.s_addr = 0;
 	serverAddr.sin_family = nn::socket::InetHtons(AF_INET);
 	serverAddr.sin_port = 0;
 	u32 addrLen = sizeof(serverAddr);
-	r = nn::socket::RecvFrom(mUDPSockFd, &message, sizeof(message), 0x80, (sockaddr*)&serverAddr, &addrLen);
+	s32 r = nn::socket::RecvFrom(mUDPSockFd, &message, sizeof(message), 0x80, (sockaddr*)&serverAddr, &addrLen);
+
+	if (mState == State::Connected) return;
 
 	if (r > 0 && serverAddr.sin_addr.s_addr != mServerIP.s_addr) {
 		mServerIP.s_addr = serverAddr.sin_addr.s_addr;
@@ -274,7 +513,7 @@ void Server::sendUDPDiscoveryBroadcast() {
 }
 
 s32 Server::connect() {
-	if (mState == State::Connected) disconnect();
+	disconnect();
 
 	// create socket
 	if ((mTCPSockFd = nn::socket::Socket(AF_INET, SOCK_STREAM, 0)) < 0) return nn::socket::GetLastErrno();
@@ -293,7 +532,12 @@ s32 Server::connect() {
 
 	// connect to server
 	nn::Result result = nn::socket::Connect(mTCPSockFd, (sockaddr*)&serverAddr, sizeof(serverAddr));
-	if (result.IsFailure()) return nn::socket::GetLastErrno();
+	if (result.IsFailure()) {
+		const s32 error = nn::socket::GetLastErrno();
+		nn::socket::Close(mTCPSockFd);
+		mTCPSockFd = -1;
+		return error;
+	}
 
 	mState = State::Connected;
 
@@ -316,27 +560,32 @@ s32 Server::connect() {
 		return nn::socket::GetLastErrno();
 	}
 
-	if (mRecvThread->isDone()) mRecvThread->start();
-
 	return 0;
 }
 
-void Server::log(const char* fmt, ...) {
+bool Server::log(const char* fmt, ...) {
 	Server* server = instance();
-	if (server->mState != State::Connected) return;
+	if (server->mState != State::Connected) return false;
+
+	SendQueue::Slot* slot = server->mSendQueue.beginPush();
+	if (!slot) return false;
 
 	va_list args;
 	va_start(args, fmt);
 
-	char message[0x400 + sizeof(PacketHeader)];
-	PacketHeader* packetHeader = reinterpret_cast<PacketHeader*>(message);
-	s32 len = vsnprintf(message + sizeof(PacketHeader), sizeof(message) - sizeof(PacketHeader), fmt, args);
-	packetHeader->type = PacketHeader::cPacketType_Log;
-	packetHeader->size = len;
-
-	s32 r = nn::socket::Send(server->mTCPSockFd, message, sizeof(PacketHeader) + len, 0);
+	// formatted straight into the queue slot, truncating anything that doesn't fit
+	s32 len = vsnprintf(cast<char*>(slot->data + sizeof(PacketHeader)), cLogTextSizeMax + 1, fmt, args);
+	if (len < 0) len = 0;
+	if (u32(len) > cLogTextSizeMax) len = cLogTextSizeMax;
 
 	va_end(args);
+
+	PacketHeader header = { .type = PacketHeader::cPacketType_Log, .size = u32(len) };
+	memcpy(slot->data, &header, sizeof(PacketHeader));
+	slot->transport = SendQueue::Transport::TCP;
+	slot->size = sizeof(PacketHeader) + len;
+	server->mSendQueue.endPush(slot);
+	return true;
 }
 
 void Server::reportStageName(const sead::SafeString& stageName, s32 scenarioNo) {
@@ -365,35 +614,101 @@ void Server::reportStageName(const sead::SafeString& stageName, s32 scenarioNo)
 
 void Server::reportPlayerPosition(const sead::Vector3f& position) {
 	Server* server = instance();
-	if (server->mState != State::Connected) return;
+	if (!server) return;
+
+	server->mPendingTelemetry.position = position;
+	server->mPendingTelemetry.flags |= TelemetryRecord::cFlag_HasPosition;
+}
+
+void Server::reportInput(const nn::hid::NpadJoyDualState& state) {
+	Server* server = instance();
+	if (!server) return;
+
+	server->mPendingTelemetry.input = state;
+	server->mPendingTelemetry.flags |= TelemetryRecord::cFlag_HasInput;
+}
+
+void Server::reportStateHash(u32 hash) {
+	Server* server = instance();
+	if (!server) return;
+
+	server->mPendingTelemetry.stateHash = hash;
+	server->mPendingTelemetry.flags |= TelemetryRecord::cFlag_HasStateHash;
+}
+
+void Server::beginTelemetryFrame() {
+	Server* server = instance();
+	if (!server) return;
+
+	server->mPendingTelemetry.tick = util::getSystemTick();
+}
+
+void Server::flushTelemetry() {
+	static_assert(sizeof(PacketHeader) + sizeof(TelemetryRecord) * cTelemetryBatchMax <= SendQueue::cMessageSizeMax);
+
+	Server* server = instance();
+	if (!server) return;
+
+	TelemetryRecord& record = server->mPendingTelemetry;
+	record.sequence = server->mTelemetrySequence++;
+	record.frameIndex = tas::System::getFrameIndex();
+	record.serverIndex = tas::System::getServerIndex();
+	record.framesReleased = tas::System::getFramesReleased();
+	record.replayId = tas::System::getReplayId();
+	record.bufferCapacity = FrameBuffer::capacity;
+	if (tas::System::isReplaying()) record.flags |= TelemetryRecord::cFlag_Replaying;
+	if (!tas::Pauser::instance()->isSequenceActive()) record.flags |= TelemetryRecord::cFlag_Paused;
+	if (tas::Pauser::instance()->isBlocked()) record.flags |= TelemetryRecord::cFlag_Blocked;
+
+	// still counted while disconnected, so sequence numbers stay tied to game frames
+	if (server->mState == State::Connected) {
+		server->mTelemetryBatch[server->mTelemetryBatchNum++] = record;
+		if (server->mTelemetryBatchNum >= server->tools.telemetryBatch) {
+			hk::Span<const TelemetryRecord> span = { server->mTelemetryBatch, server->mTelemetryBatchNum };
+			server->sendUDPDatagram(Server::PacketHeader::cPacketType_Telemetry, cast<const u8>(span));
+			server->mTelemetryBatchNum = 0;
+		}
+	} else {
+		server->mTelemetryBatchNum = 0;
+	}
 
-	hk::Span<const sead::Vector3f> span = { &position, 1 };
-	server->sendUDPDatagram(Server::PacketHeader::cPacketType_ReportPosition, cast<const u8>(span));
+	record.flags = 0;
 }
 
-void Server::reportInput(const nn::hid::NpadJoyDualState& position) {
+void Server::reportStageLoaded() {
 	Server* server = instance();
-	if (!server || server->mState != State::Connected) return;
+	if (server->mStageChangeStartTick == 0) return;
 
-	hk::Span<const nn::hid::NpadJoyDualState> span = { &position, 1 };
-	server->sendUDPDatagram(Server::PacketHeader::cPacketType_ReportInput, cast<const u8>(span));
+	const u64 ms = util::ticksToMicroseconds(util::getSystemTick() - server->mStageChangeStartTick) / 1000;
+	server->mStageChangeStartTick = 0;
+	Menu::log("%s took %lums", server->mIsReloadingStage ? "reload" : "stage change", ms);
+	Server::log("%s took %lums", server->mIsReloadingStage ? "reload" : "stage change", ms);
 }
 
 void Server::reportScriptCompleted() {
+	Server* server = instance();
+	if (server->mState != State::Connected) return;
+
+	// just the header: sendTCPMessage sends header.size bytes past it, so the size has to match what follows
 	struct [[gnu::packed]] {
 		PacketHeader header;
 	} message = {
-		.header = { .type = PacketHeader::cPacketType_FullFrameBuffer, .size = 4 },
+		.header = { .type = PacketHeader::cPacketType_ScriptEnded, .size = 0 },
 	};
 
-	instance()->sendTCPMessage(message);
+	server->sendTCPMessage(message);
 }
 
 void Server::disconnect() {
+	// only whoever moves the state off Connected (or Lost) gets to close the socket
+	const State state = mState.exchange(State::Disconnected);
+	if (state != State::Connected && state != State::Lost) return;
+
 	Menu::log("disconnected from server");
-	mState = State::Disconnected;
 	nn::socket::Close(mTCPSockFd);
-	tas::System::stopReplay();
+	mTCPSockFd = -1;
+	// a cached script doesn't need us
+	if (!tas::System::isPlayingFromCache()) tas::System::requestStopReplay();
 }
 
 void Server::handleStageChange(HakoniwaSequence* sequence) {
@@ -403,13 +718,20 @@ void Server::handleStageChange(HakoniwaSequence* sequence) {
 	if (!server->changeStageInfo.mHasChangeStageInfo.compare_exchange_strong(has, false, std::memory_order_seq_cst, std::memory_order_relaxed)) return;
 	server->changeStageInfo.mHasChangeStageInfo = false;
 
+	GameDataHolder* gameDataHolder = sequence->mGameDataHolderAccessor;
+	server->mStageChangeStartTick = util::getSystemTick();
+
+	// restarts the current stage and scenario in place, the same way the game does when the player dies,
+	// so none of the world map or sequence transitions run and the stage's archives stay resident
 	if (server->changeStageInfo.mSimpleReload) {
-		Server::log("NOT restarting stage (todo: reloads)");
+		Menu::log("reloading stage");
+		server->mIsReloadingStage = true;
+		GameDataFunction::restartStage(gameDataHolder);
 		return;
 	}
 
 	Menu::log("changing to stage %s", server->changeStageInfo.mStageName.data());
-	GameDataHolder* gameDataHolder = sequence->mGameDataHolderAccessor;
+	server->mIsReloadingStage = false;
 	ChangeStageInfo info(
 		gameDataHolder, server->changeStageInfo.mEntranceName.data(), server->changeStageInfo.mStageName.data(), server->changeStageInfo.mIsReturn,
 		server->changeStageInfo.mScenario, server->changeStageInfo.mSubScenario
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "framewindow.h"
+#include "sendqueue.h"
+
 #include <hk/container/FixedString.h>
 #include <hk/container/Span.h>
 #include <hk/os/Event.h>
@@ -7,6 +10,7 @@
 #include <hk/util/Math.h>
 
 #include <atomic>
+#include <cstddef>
 #include <netinet/in.h>
 
 #include <nn/hid.h>
@@ -30,6 +34,8 @@ private:
 		Uninitialised,
 		Disconnected,
 		Connected,
+		// a send failed. the socket is still open until the recv thread tears the connection down
+		Lost,
 	};
 
 	struct [[gnu::packed]] PacketHeader {
@@ -53,6 +59,14 @@ private:
 			cPacketType_ReloadStage,
 			cPacketType_ReportInput,
 			cPacketType_UpdateTool,
+			cPacketType_FrameBatch,
+			cPacketType_FrameDelta,
+			cPacketType_CacheBegin,
+			cPacketType_CacheBlock,
+			cPacketType_CacheEnd,
+			cPacketType_StartCachedScript,
+			cPacketType_Telemetry,
+			cPacketType_Desync,
 		};
 
 		PacketType type;
@@ -63,15 +77,29 @@ private:
 		u16 version;
 	};
 
+	struct [[gnu::packed]] ChangeStagePacket {
+		s32 scenario;
+		u8 subScenario;
+		bool isReturn;
+		u16 stageNameSize;
+		u16 entranceNameSize;
+		// followed by stage name and entrance name
+	};
+
+	struct DesyncPacket {
+		// first frame of the replay whose state hash didn't match the reference run's
+		u32 frameIndex;
+	};
+
 public:
+	// no gyro: nothing in the headers we build against holds a controller's angular velocity for it to be written to,
+	// so scripts with gyro data are refused by the server rather than sent and dropped here
 	struct [[gnu::packed]] Controller {
 		u64 buttons;
 		sead::Vector2i leftStick;
 		sead::Vector2i rightStick;
 		sead::Vector3f accelLeft;
-		sead::Vector3f gyroLeft;
 		sead::Vector3f accelRight;
-		sead::Vector3f gyroRight;
 	};
 
 	struct [[gnu::packed]] FramePacket {
@@ -83,57 +111,151 @@ public:
 		u64 amiibo;
 	};
 
+	struct StartScriptPacket {
+		// echoed back in telemetry, so credits from a previous replay are ignored
+		u32 replayId;
+	};
+
 	struct ScriptInfoPacket {
 		u32 frameCount;
 		u8 playerCount;
 		u8 controllerTypes[2];
 	};
 
+	constexpr static s32 cStageNameLenMax = 128;
+
 	struct {
 		std::atomic_bool mHasChangeStageInfo = false;
 		std::atomic_bool mSimpleReload = false;
 		std::atomic_bool mIsReturn = false;
 		std::atomic<s32> mScenario = 0;
 		std::atomic<ChangeStageInfo::SubScenarioType> mSubScenario = ChangeStageInfo::NO_SUB_SCENARIO;
-		hk::FixedString<128> mStageName;
-		hk::FixedString<128> mEntranceName;
+		hk::FixedString<cStageNameLenMax> mStageName;
+		hk::FixedString<cStageNameLenMax> mEntranceName;
 	} changeStageInfo;
 
 	struct [[gnu::packed]] UpdateToolPacket {
 		enum class ToolType : u8 {
 			ShowUI,
 			AlwaysUncollectedMoons,
+			TelemetryBatch,
+			FastForward,
 		} toolType;
 		u8 data[16];
 	};
 
+	// one per game frame, sent to the server over UDP in batches of tools.telemetryBatch
+	struct TelemetryRecord {
+		enum Flag : u32 {
+			cFlag_HasPosition = 1 << 0,
+			cFlag_HasInput = 1 << 1,
+			cFlag_Replaying = 1 << 2,
+			cFlag_Paused = 1 << 3,
+			// the game was held back this frame because the frame buffer ran dry
+			cFlag_Blocked = 1 << 4,
+			// stateHash was computed this frame, i.e. the scene updated
+			cFlag_HasStateHash = 1 << 5,
+		};
+
+		// counts up once per game frame, so the server can tell when datagrams were lost
+		u32 sequence;
+		u32 frameIndex;
+		u32 serverIndex;
+		u32 flags;
+		sead::Vector3f position;
+		// flow control: frames of replay `replayId` that have left the frame buffer.
+		// the server may have at most `bufferCapacity` frames sent but not yet released
+		u32 framesReleased;
+		nn::hid::NpadJoyDualState input;
+		u32 replayId;
+		u32 bufferCapacity;
+		// system tick on entering GameSystem::movement, so the server can time every frame and tell lag frames apart
+		u64 tick;
+		// see statehash.h. the server compares it against the same frame of a reference run to catch desyncs
+		u32 stateHash;
+	};
+
+	// the wire layout the server reads (TelemetryRecord in server/src/server/protocol.rs).
+	// input's natural alignment decides where everything after it lands, so its size and padding are pinned too
+	static_assert(offsetof(TelemetryRecord, input) == 32);
+	static_assert(offsetof(TelemetryRecord, replayId) == 72);
+	static_assert(offsetof(TelemetryRecord, tick) == 80);
+	static_assert(sizeof(TelemetryRecord) == 96);
+
+	constexpr static s32 cTelemetryBatchMax = 4;
+
 	struct Tools {
 		bool showUi = true;
 		bool alwaysUncollectedMoons = true;
+		std::atomic<s32> telemetryBatch = 1;
 	} tools;
 
 private:
 	constexpr static s32 cPort = 8171;
+	constexpr static u32 cRecvBufSize = 0x2800;
+	// upper bound on how long the recv thread sleeps before noticing a connection made from another thread
+	constexpr static s32 cPollTimeoutMs = 100;
+	// how long the send thread sleeps once it has drained the send queue
+	constexpr static s64 cSendPollNs = 1'000'000;
+	constexpr static u32 cSendBatchSize = 0x1000;
 
 	sead::Heap* mHeap = nullptr;
 	al::AsyncFunctorThread* mRecvThread = nullptr;
+	al::AsyncFunctorThread* mSendThread = nullptr;
 	void* mThreadStack = nullptr;
 	in_addr mServerIP;
 	in_addr mBroadcastIP;
 	s32 mTCPSockFd = -1; // for receiving script data, sending logs
 	s32 mUDPSockFd = -1; // for sending real-time game info/inputs
-	State mState = State::Uninitialised;
+	// the connection is only set up and torn down on the recv thread, the other threads only read this or mark it Lost
+	std::atomic<State> mState = State::Uninitialised;
+	std::atomic_bool mIsConnectRequested = false;
+
+	// scratch space for every non-frame packet body, so nothing sized by the server ends up on the recv thread's stack
+	u8 mRecvBuf[cRecvBufSize];
+
+	// game thread only
+	TelemetryRecord mPendingTelemetry = {};
+	TelemetryRecord mTelemetryBatch[cTelemetryBatchMax];
+	s32 mTelemetryBatchNum = 0;
+	u32 mTelemetrySequence = 0;
+	// set when a requested stage change or reload starts, cleared once the new scene has loaded
+	u64 mStageChangeStartTick = 0;
+	bool mIsReloadingStage = false;
+
+	// every outgoing message except the initial handshake goes through here, so callers never wait on the socket
+	SendQueue mSendQueue;
+	// consecutive TCP messages are coalesced into one Send, send thread only
+	u8 mSendBuf[cSendBatchSize];
 
 	void threadRecv();
+	void threadSend();
+	s32 connect();
+	void disconnect();
+	void flushTCP(u32 size);
+	bool pushMessage(SendQueue::Transport transport, PacketHeader::PacketType type, hk::Span<const u8> data);
 	hk::Result handlePacket();
+	void handleDiscoveryReply();
+	hk::Result handleFramePacket(u32 size);
+	hk::Result handleFrameBatchPacket(u32 size);
+	hk::Result handleFrameDeltaPacket(u32 size);
+	// returns true (having asked the server to resend) if frames have to wait for a replay to start
+	bool isWaitingOnReplayStart();
+	// receives one FramePacket into its slot in the frame buffer, or discards it if it isn't wanted.
+	// sets `isFull` (having asked the server to back off) if it was too far ahead to fit
+	hk::Result recvFrame(bool* isFull);
+	void sendBackOff(u32 serverIndex);
+	hk::Result discardAll(u32 size);
 	s32 recvAll(u8* recvBuf, s32 remaining);
+	static u32 getMaxBodySize(PacketHeader::PacketType type);
 
 public:
 	Server() = default;
 
 	void init(sead::Heap* heap);
-	s32 connect();
-	void disconnect();
+	// (re)connects to the last server found, on the recv thread
+	void requestConnect() { mIsConnectRequested = true; }
+	// both of these only queue the message, and return false if it had to be dropped
 	bool sendTCPMessage(hk::Span<const u8> data);
 
 	template <typename T>
@@ -141,45 +263,32 @@ public:
 		return sendTCPMessage(hk::Span { cast<const u8*>(&message), sizeof(PacketHeader) + message.header.size });
 	}
 
-	s32 sendUDPDatagram(PacketHeader::PacketType type, hk::Span<const u8> data);
+	bool sendUDPDatagram(PacketHeader::PacketType type, hk::Span<const u8> data);
 	void sendUDPDiscoveryBroadcast();
 
-	static void log(const char* fmt, ...);
+	// longest log message text, anything longer is truncated
+	constexpr static u32 cLogTextSizeMax = SendQueue::cMessageSizeMax - sizeof(PacketHeader) - 1;
+
+	static bool isConnected() { return instance()->mState == State::Connected; }
+
+	// returns false if the message was dropped, either because there's no connection or the send queue is full
+	static bool log(const char* fmt, ...);
 	static void reportStageName(const sead::SafeString& stageName, s32 scenarioNo);
 	static void reportPlayerPosition(const sead::Vector3f& position);
 	static void reportInput(const nn::hid::NpadJoyDualState& state);
+	static void reportStateHash(u32 hash);
+	// stamps the current frame's telemetry record with the time the frame started
+	static void beginTelemetryFrame();
+	// closes the current frame's telemetry record, sending the batch once it is full
+	static void flushTelemetry();
+	// reports how long the last requested stage change or reload took, once the scene has loaded
+	static void reportStageLoaded();
 	static void reportScriptCompleted();
 	static void handleStageChange(HakoniwaSequence* sequence);
 
-	struct FrameBuffer {
-		constexpr static s32 capacity = 60;
-		std::atomic<u32> count = 0;
-		std::atomic<u32> readHead = 0;
-		std::atomic<u32> writeHead = 0;
-		FramePacket buf[capacity];
-
-		void clear() {
-			count = 0;
-			readHead = 0;
-			writeHead = 0;
-		}
-
-		void push(FramePacket& frame) {
-			if (count >= capacity) return;
-			buf[writeHead++] = frame;
-			if (writeHead >= capacity) writeHead -= capacity;
-			count++;
-		}
-
-		hk::ValueOrResult<FramePacket> pop() {
-			if (count <= 0) return hk::ResultNoValue();
-
-			FramePacket packet = buf[readHead++];
-			if (readHead >= capacity) readHead -= capacity;
-			count--;
-			return packet;
-		}
-	} mFrameBuffer;
+	// filled by the recv thread, drained by the game thread. keyed by FramePacket::serverIndex
+	using FrameBuffer = FrameWindow<FramePacket, 64>;
+	FrameBuffer mFrameBuffer;
 };
 
 } // namespace cly
@@ -0,0 +1,94 @@
+#include "statehash.h"
+#include "util.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include <sead/math/seadVector.h>
+#include <sead/random/seadGlobalRandom.h>
+
+#include "Library/LiveActor/ActorPoseUtil.h"
+#include "Library/LiveActor/LiveActor.h"
+#include "Library/Nerve/Nerve.h"
+#include "Library/Nerve/NerveUtil.h"
+
+namespace cly::statehash {
+
+namespace {
+
+#if !defined(__ARM_FEATURE_CRC32)
+// reversed castagnoli polynomial, the one the armv8 crc32c instructions use
+constexpr u32 cPolynomial = 0x82F63B78;
+
+constexpr std::array<u32, 256> makeTable() {
+	std::array<u32, 256> table = {};
+	for (u32 i = 0; i < 256; i++) {
+		u32 crc = i;
+		for (s32 bit = 0; bit < 8; bit++)
+			crc = crc & 1 ? (crc >> 1) ^ cPolynomial : crc >> 1;
+		table[i] = crc;
+	}
+	return table;
+}
+
+constexpr std::array<u32, 256> cTable = makeTable();
+#endif
+
+// game thread only
+u32 sStageHash = 0;
+// nerves are static singletons, so a nerve pointer identifies its type. only the type's name goes into the hash though,
+// since the pointer changes with wherever the game was loaded
+const al::Nerve* sNerve = nullptr;
+u32 sNerveHash = 0;
+
+} // namespace
+
+u32 crc32(u32 crc, const void* data, size_t size) {
+	const u8* bytes = static_cast<const u8*>(data);
+	crc = ~crc;
+
+#if defined(__ARM_FEATURE_CRC32)
+	for (; size >= sizeof(u64); size -= sizeof(u64), bytes += sizeof(u64)) {
+		u64 word;
+		memcpy(&word, bytes, sizeof(word));
+		crc = __crc32cd(crc, word);
+	}
+	for (; size > 0; size--)
+		crc = __crc32cb(crc, *bytes++);
+#else
+	for (; size > 0; size--)
+		crc = cTable[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+#endif
+
+	return ~crc;
+}
+
+void setStage(const char* stageName, s32 scenarioNo) {
+	sStageHash = crc32(crc32(0, stageName, strlen(stageName)), &scenarioNo, sizeof(scenarioNo));
+}
+
+u32 compute(const al::LiveActor* player) {
+	u32 hash = sStageHash;
+
+	// every call to al::getRandom advances this, so anything random that happened differently shows up here first
+	if (const sead::Random* random = sead::GlobalRandom::instance()) hash = crc32(hash, random, sizeof(sead::Random));
+
+	if (!player) return hash;
+
+	hash = crc32(hash, &al::getTrans(player), sizeof(sead::Vector3f));
+	hash = crc32(hash, &al::getVelocity(player), sizeof(sead::Vector3f));
+
+	const al::Nerve* nerve = al::getCurrentNerve(player);
+	if (nerve != sNerve) {
+		sNerve = nerve;
+		const char* name = nerve ? util::getTypeName(nerve) : "";
+		sNerveHash = crc32(0, name, strlen(name));
+	}
+	return crc32(hash, &sNerveHash, sizeof(sNerveHash));
+}
+
+} // namespace cly::statehash
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace al {
+class LiveActor;
+} // namespace al
+
+namespace cly::statehash {
+
+// crc32c (castagnoli) of `size` bytes, continuing from `crc`. 0 starts a new checksum.
+// uses the armv8 crc32 instructions when the target has them, and a table otherwise
+u32 crc32(u32 crc, const void* data, size_t size);
+
+// the stage and scenario go into every hash. called whenever a scene starts loading
+void setStage(const char* stageName, s32 scenarioNo);
+
+// hash of the state that has to come out the same on every replay of a script: the player's trans, velocity and nerve,
+// the global rng and the stage. nothing in it depends on where the module or the heaps were loaded.
+// player may be null, e.g. while the stage is loading
+u32 compute(const al::LiveActor* player);
+
+} // namespace cly::statehash
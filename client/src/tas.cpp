@@ -2,6 +2,8 @@
 
 #include <hk/diag/diag.h>
 
+#include <cstring>
+
 #include <nn/fs.h>
 #include <sead/controller/seadAccelerometerAddon.h>
 #include <sead/controller/seadController.h>
@@ -9,7 +11,10 @@
 
 #include "main.h"
 #include "menu.h"
+#include "recorder.h"
+#include "scriptcache.h"
 #include "server.h"
+#include "trace.h"
 
 namespace cly::tas {
 
@@ -26,82 +31,172 @@ bool System::isApplyingInput() {
 
 void System::checkForNextFrame() {
 	System* self = instance();
-	if (!self->isReplaying()) return;
-
-	if (self->mFrameIdx >= self->mScriptInfo.frameCount) {
-		if (self->mFrameIdx == self->mScriptInfo.frameCount) {
-			self->mFrameIdx++;
-			Menu::log("script ended? %d %d", self->mFrameIdx, self->mScriptInfo.frameCount);
-			Server::reportScriptCompleted();
-			self->stopReplay();
-		}
+	self->handleRequests();
+	if (!self->isReplaying()) {
+		// whatever the last replay traced goes out a little at a time
+		trace::flushToServer();
 		return;
 	}
 
-	if (!self->mHasCurFrame) {
-		for (int i = 0; i < 30; i++) {
-			auto result = Server::instance()->mFrameBuffer.pop();
-			if (!result.hasValue()) {
-				Pauser::instance()->setBlocked(true);
-				break;
-			}
-
-			self->mCurFrame = HK_UNWRAP(result);
-			if (self->mCurFrame.frameIndex != self->mNextFrameIdx) {
-				continue;
-			}
+	if (self->mSpanIdx >= self->mScriptInfo.frameCount) {
+		Menu::log("script ended at frame %d", self->mFrameIdx);
+		Server::reportScriptCompleted();
+		self->stopReplay();
+		return;
+	}
 
-			self->mHasCurFrame = true;
-			Pauser::instance()->setBlocked(false);
-			self->mNextFrameIdx = self->mCurFrame.nextFrameIndex;
-			break;
+	// a span covers every game frame until the next one starts, so there's only something to fetch once the current one has run out
+	if (!self->mCurFrame) {
+		// the frame buffer is keyed by serverIndex, so the next span is always the one at its base
+		const Server::FramePacket* frame = self->peekFrame();
+		if (!frame) {
+			if (!Pauser::instance()->isBlocked()) self->mStats.underruns++;
+			self->mStats.blockedFrames++;
+			Pauser::instance()->setBlocked(true);
+			return;
 		}
+
+		self->mCurFrame = frame;
+		self->mServerIdx = frame->serverIndex;
+		Pauser::instance()->setBlocked(false);
 	}
 }
 
 void System::getNextFrame() {
 	System* self = instance();
-	if (isApplyingInput() && self->mHasCurFrame) {
-		if (self->mFrameIdx < self->mNextFrameIdx) self->mFrameIdx++;
-		self->mHasCurFrame = false;
+	if (!isApplyingInput() || !self->mCurFrame) return;
+
+	// traced here rather than where it's read, since that happens once per controller
+	const Server::FramePacket* frame = self->mCurFrame;
+	if (frame->frameIndex == self->mFrameIdx) trace::record<trace::cLevel_Frame>(*frame);
+
+	self->mFrameIdx++;
+	self->mStats.appliedFrames++;
+
+	// the last span of a script has no end of its own, it's only played for a single frame
+	if (frame->nextFrameIndex == cNoNextFrame || self->mFrameIdx >= frame->nextFrameIndex) {
+		self->mLastFrame = *frame;
+		self->mCurFrame = nullptr;
+		self->mSpanIdx++;
+		self->popFrame();
 	}
 }
 
-Server::FramePacket System::tryReadCurFrame() {
-	System* self = instance();
+const Server::FramePacket* System::peekFrame() {
+	return mIsPlayingFromCache ? ScriptCache::instance()->peek() : Server::instance()->mFrameBuffer.peek();
+}
 
-	if (isApplyingInput() && self->mHasCurFrame && self->mCurFrame.frameIndex == self->mFrameIdx) {
-		Menu::log(
-			"%04d->%04d: %016lx %06d %06d", self->mFrameIdx, self->mCurFrame.nextFrameIndex, self->mCurFrame.player1.buttons,
-			self->mCurFrame.player1.leftStick.x, self->mCurFrame.player1.leftStick.y
-		);
-		return self->mLastFrame = self->mCurFrame;
+void System::popFrame() {
+	if (mIsPlayingFromCache) {
+		ScriptCache::instance()->pop();
+	} else {
+		Server::instance()->mFrameBuffer.pop();
+		mFramesReleased++;
 	}
+}
 
+const Server::FramePacket& System::tryReadCurFrame() {
+	System* self = instance();
+
+	// mCurFrame stays put until getNextFrame releases it, so there's no need to copy it out every frame
+	const Server::FramePacket* frame = self->mCurFrame;
+	if (isApplyingInput() && frame && frame->frameIndex <= self->mFrameIdx) return *frame;
+
+	// before the first span starts, or while waiting on the next one
 	return self->mLastFrame;
 }
 
-void System::startReplay() {
+void System::resetReplay() {
+	mFrameIdx = 0;
+	mSpanIdx = 0;
+	mServerIdx = 0;
+	mCurFrame = nullptr;
+	memset(&mLastFrame, 0, sizeof(mLastFrame));
+}
+
+void System::requestStartReplay(u32 replayId) {
+	System* self = instance();
+	self->mRequestedReplayId.store(replayId, std::memory_order_relaxed);
+	self->mStartsRequested.fetch_add(1, std::memory_order_release);
+}
+
+void System::requestStartCachedReplay() {
+	instance()->mRequests.fetch_or(cRequest_StartCached, std::memory_order_release);
+}
+
+void System::requestStopReplay() {
+	System* self = instance();
+	self->mStartsCancelled.store(self->mStartsRequested.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	self->mRequests.store(cRequest_Stop, std::memory_order_release);
+}
+
+bool System::isStartPending() {
+	System* self = instance();
+	return self->mStartsRequested.load(std::memory_order_relaxed) != self->mStartsHandled.load(std::memory_order_acquire);
+}
+
+void System::handleRequests() {
+	const u8 requests = mRequests.exchange(0, std::memory_order_acquire);
+	if (requests & cRequest_Stop) stopReplay();
+
+	const u32 starts = mStartsRequested.load(std::memory_order_acquire);
+	if (starts != mStartsHandled.load(std::memory_order_relaxed)) {
+		if (starts != mStartsCancelled.load(std::memory_order_relaxed)) startReplay(mRequestedReplayId.load(std::memory_order_relaxed));
+		// only now that the frame buffer has been reset can the recv thread write to it again
+		mStartsHandled.store(starts, std::memory_order_release);
+	}
+
+	if (requests & cRequest_StartCached) startCachedReplay();
+}
+
+void System::startReplay(u32 replayId) {
 	System* self = instance();
 	if (self->mIsReplaying) return;
-	Server::instance()->mFrameBuffer.clear();
+	// the recv thread holds off on writing frames while a start is pending, and startReplay is only called from the game thread,
+	// so nothing else is touching the buffer
+	Server::instance()->mFrameBuffer.reset();
 
+	self->resetReplay();
+	self->mReplayId = replayId;
+	self->mFramesReleased = 0;
+	self->mStats = {};
+	self->mIsPlayingFromCache = false;
 	self->mIsReplaying = true;
-	self->mFrameIdx = 0;
-	self->mNextFrameIdx = 0;
-	self->mCurFrame.serverIndex = 0;
 	Menu::log("started replaying");
 }
 
+void System::startCachedReplay(const char* path) {
+	System* self = instance();
+	if (self->mIsReplaying) return;
+
+	if (Recorder::isRecording()) {
+		Menu::log("can't replay while recording");
+		return;
+	}
+
+	if (!ScriptCache::instance()->startStreaming(&self->mScriptInfo, path ? path : ScriptCache::cFilePath)) {
+		Menu::log("no cached script to play");
+		return;
+	}
+
+	self->resetReplay();
+	self->mStats = {};
+	self->mIsPlayingFromCache = true;
+	self->mIsReplaying = true;
+	Menu::log("started replaying from cache");
+}
+
 void System::stopReplay() {
 	System* self = instance();
 	if (self->mIsReplaying) {
 		self->mIsReplaying = false;
-		self->mFrameIdx = 0;
-		self->mHasCurFrame = false;
-		self->mCurFrame.serverIndex = 0;
+		self->resetReplay();
 		Pauser::instance()->setBlocked(false);
-		Server::instance()->mFrameBuffer.clear();
+		// the frame buffer is left as it is, the recv thread may still be writing to it. the next startReplay resets it
+		if (self->mIsPlayingFromCache) ScriptCache::instance()->stopStreaming();
+		self->mIsPlayingFromCache = false;
+		const Stats& stats = self->mStats;
+		Server::log("replay stats: %d applied, %d blocked in %d underruns", stats.appliedFrames, stats.blockedFrames, stats.underruns);
 		Menu::log("stopped replaying");
 	}
 }
@@ -118,7 +213,15 @@ void System::processInputs(al::NpadController* controller) {
 		cly::Menu::instance()->handleInput(controller->mPadHold);
 	}
 
-	if (!isApplyingInput()) return;
+	// in "any" mode the controller follows whichever npad was used last, which is player 1's
+	const s32 player = controller->mControllerMode == -1 ? 0 : controller->mControllerMode;
+	if (player >= cPlayerNum) return;
+
+	System* self = instance();
+	if (!isApplyingInput()) {
+		if (Recorder::isRecording()) Recorder::capture(player, self->getInjectTarget(player, controller));
+		return;
+	}
 
 	// if (cly::Menu::isActive()) {
 	// 	controller->mPadHold.makeAllZero();
@@ -126,81 +229,112 @@ void System::processInputs(al::NpadController* controller) {
 	// 	controller->mRightStick.set(sead::Vector2f::zero);
 	// }
 
-	if (controller->mControllerMode == -1 || controller->mControllerMode == 0) {
-		// player 1
-		auto frame = tryReadCurFrame();
-		controller->mPadHold = convertButtonsSTASToSead(frame.player1.buttons);
-		controller->mLeftStick.set({ f32(frame.player1.leftStick.x) / 32767.f, f32(frame.player1.leftStick.y) / 32767.f });
-		controller->mRightStick.set({ f32(frame.player1.rightStick.x) / 32767.f, f32(frame.player1.rightStick.y) / 32767.f });
-		auto applyAccel = [&](s32 index, const sead::Vector3f& accel) {
-			auto addon = static_cast<sead::AccelerometerAddon*>(controller->getAddonByOrder(sead::ControllerDefine::cAddon_Accelerometer, index));
-			addon->mAcceleration.set(accel);
-		};
-		applyAccel(0, frame.player1.accelLeft);
-		if (isDualJoycons(0)) applyAccel(1, frame.player1.accelRight);
-	} else if (controller->mControllerMode == 1) {
-		// player 2
-	}
+	// a one player script leaves the second controller to whoever is holding it
+	if (player >= self->mScriptInfo.playerCount) return;
+
+	const auto& frame = tryReadCurFrame();
+	applyController(self->getInjectTarget(player, controller), player == 0 ? frame.player1 : frame.player2, isDualJoycons(player));
 }
 
-sead::BitFlag32 convertButtonsSTASToSead(sead::BitFlag64 stasPad) {
-	sead::BitFlag32 mask = 0;
-	for (s32 i = 0; i < 64; i++) {
-		if (stasPad.isOnBit(i)) {
-			if (i == cSTAS_A)
-				mask.setBit(sead::Controller::cPadIdx_A);
-			else if (i == cSTAS_B)
-				mask.setBit(sead::Controller::cPadIdx_B);
-			else if (i == cSTAS_X)
-				mask.setBit(sead::Controller::cPadIdx_X);
-			else if (i == cSTAS_Y)
-				mask.setBit(sead::Controller::cPadIdx_Y);
-			else if (i == cSTAS_LeftStick)
-				mask.setBit(sead::Controller::cPadIdx_1);
-			else if (i == cSTAS_RightStick)
-				mask.setBit(sead::Controller::cPadIdx_2);
-			else if (i == cSTAS_L)
-				mask.setBit(sead::Controller::cPadIdx_L);
-			else if (i == cSTAS_R)
-				mask.setBit(sead::Controller::cPadIdx_R);
-			else if (i == cSTAS_ZL)
-				mask.setBit(sead::Controller::cPadIdx_ZL);
-			else if (i == cSTAS_ZR)
-				mask.setBit(sead::Controller::cPadIdx_ZR);
-			else if (i == cSTAS_Plus) {
-				mask.setBit(sead::Controller::cPadIdx_Plus);
-				mask.setBit(sead::Controller::cPadIdx_Start);
-			} else if (i == cSTAS_Minus)
-				mask.setBit(sead::Controller::cPadIdx_Minus);
-			else if (i == cSTAS_DLeft)
-				mask.setBit(sead::Controller::cPadIdx_Left);
-			else if (i == cSTAS_DUp)
-				mask.setBit(sead::Controller::cPadIdx_Up);
-			else if (i == cSTAS_DRight)
-				mask.setBit(sead::Controller::cPadIdx_Right);
-			else if (i == cSTAS_DDown)
-				mask.setBit(sead::Controller::cPadIdx_Down);
-			// no longer a part of odyssey's defined script format
-			// else if (i == cSTAS_LeftStickLeft)
-			// 	mask.setBit(sead::Controller::cPadIdx_LeftStickLeft);
-			// else if (i == cSTAS_LeftStickUp)
-			// 	mask.setBit(sead::Controller::cPadIdx_LeftStickUp);
-			// else if (i == cSTAS_LeftStickRight)
-			// 	mask.setBit(sead::Controller::cPadIdx_LeftStickRight);
-			// else if (i == cSTAS_LeftStickDown)
-			// 	mask.setBit(sead::Controller::cPadIdx_LeftStickDown);
-			// else if (i == cSTAS_RightStickLeft)
-			// 	mask.setBit(sead::Controller::cPadIdx_RightStickLeft);
-			// else if (i == cSTAS_RightStickUp)
-			// 	mask.setBit(sead::Controller::cPadIdx_RightStickUp);
-			// else if (i == cSTAS_RightStickRight)
-			// 	mask.setBit(sead::Controller::cPadIdx_RightStickRight);
-			// else if (i == cSTAS_RightStickDown)
-			// 	mask.setBit(sead::Controller::cPadIdx_RightStickDown);
+const System::InjectTarget& System::getInjectTarget(s32 player, al::NpadController* controller) {
+	InjectTarget& target = mInjectTargets[player];
+	if (target.controller == controller && target.npadId == controller->mNpadId) return target;
+
+	target.controller = controller;
+	target.npadId = controller->mNpadId;
+	for (s32 i = 0; i < cAccelNum; i++)
+		target.accel[i] = static_cast<sead::AccelerometerAddon*>(controller->getAddonByOrder(sead::ControllerDefine::cAddon_Accelerometer, i));
+	return target;
+}
+
+void System::applyController(const InjectTarget& target, const Server::Controller& state, bool isDualJoycons) {
+	al::NpadController* controller = target.controller;
+	controller->mPadHold = convertButtonsSTASToSead(state.buttons);
+	controller->mLeftStick.set({ f32(state.leftStick.x) / 32767.f, f32(state.leftStick.y) / 32767.f });
+	controller->mRightStick.set({ f32(state.rightStick.x) / 32767.f, f32(state.rightStick.y) / 32767.f });
+
+	if (target.accel[0]) target.accel[0]->mAcceleration.set(state.accelLeft);
+	if (isDualJoycons && target.accel[1]) target.accel[1]->mAcceleration.set(state.accelRight);
+}
+
+namespace {
+
+struct ButtonMapping {
+	s32 stasIdx;
+	u32 seadMask;
+};
+
+constexpr u32 padBit(s32 idx) {
+	return 1u << idx;
+}
+
+constexpr ButtonMapping cButtonMappings[] = {
+	{ cSTAS_A, padBit(sead::Controller::cPadIdx_A) },
+	{ cSTAS_B, padBit(sead::Controller::cPadIdx_B) },
+	{ cSTAS_X, padBit(sead::Controller::cPadIdx_X) },
+	{ cSTAS_Y, padBit(sead::Controller::cPadIdx_Y) },
+	{ cSTAS_LeftStick, padBit(sead::Controller::cPadIdx_1) },
+	{ cSTAS_RightStick, padBit(sead::Controller::cPadIdx_2) },
+	{ cSTAS_L, padBit(sead::Controller::cPadIdx_L) },
+	{ cSTAS_R, padBit(sead::Controller::cPadIdx_R) },
+	{ cSTAS_ZL, padBit(sead::Controller::cPadIdx_ZL) },
+	{ cSTAS_ZR, padBit(sead::Controller::cPadIdx_ZR) },
+	{ cSTAS_Plus, padBit(sead::Controller::cPadIdx_Plus) | padBit(sead::Controller::cPadIdx_Start) },
+	{ cSTAS_Minus, padBit(sead::Controller::cPadIdx_Minus) },
+	{ cSTAS_DLeft, padBit(sead::Controller::cPadIdx_Left) },
+	{ cSTAS_DUp, padBit(sead::Controller::cPadIdx_Up) },
+	{ cSTAS_DRight, padBit(sead::Controller::cPadIdx_Right) },
+	{ cSTAS_DDown, padBit(sead::Controller::cPadIdx_Down) },
+	// no longer a part of odyssey's defined script format:
+	// LeftStick{Left,Up,Right,Down}, RightStick{Left,Up,Right,Down}
+};
+
+// every STAS button lives in the low 16 bits and every sead button in the low 32,
+// so each conversion is one table lookup per byte of the source mask, OR'd together
+constexpr s32 cSTASTableNum = 2;
+constexpr s32 cSeadTableNum = 4;
+
+template <typename Out, s32 TableNum, bool ToSead>
+struct ByteTables {
+	Out table[TableNum][256] {};
+
+	constexpr ByteTables() {
+		for (s32 byte = 0; byte < TableNum; byte++) {
+			for (u32 value = 0; value < 256; value++) {
+				const u64 srcMask = u64(value) << (byte * 8);
+				Out out = 0;
+				for (const ButtonMapping& mapping : cButtonMappings) {
+					if constexpr (ToSead) {
+						if (srcMask & (1ull << mapping.stasIdx)) out |= mapping.seadMask;
+					} else {
+						if (srcMask & mapping.seadMask) out |= Out(1) << mapping.stasIdx;
+					}
+				}
+				table[byte][value] = out;
+			}
 		}
 	}
+};
+
+constexpr ByteTables<u32, cSTASTableNum, true> cSTASToSead;
+constexpr ByteTables<u16, cSeadTableNum, false> cSeadToSTAS;
+
+static_assert(cSTASToSead.table[0][1 << cSTAS_A] == padBit(sead::Controller::cPadIdx_A));
+static_assert(cSTASToSead.table[1][1 << (cSTAS_Plus - 8)] == (padBit(sead::Controller::cPadIdx_Plus) | padBit(sead::Controller::cPadIdx_Start)));
+
+} // namespace
+
+sead::BitFlag32 convertButtonsSTASToSead(sead::BitFlag64 stasPad) {
+	const u64 bits = stasPad.getDirect();
+	return cSTASToSead.table[0][bits & 0xff] | cSTASToSead.table[1][(bits >> 8) & 0xff];
+}
 
-	return mask;
+sead::BitFlag64 convertButtonsSeadToSTAS(sead::BitFlag32 seadPad) {
+	const u32 bits = seadPad.getDirect();
+	u64 out = 0;
+	for (s32 byte = 0; byte < cSeadTableNum; byte++)
+		out |= cSeadToSTAS.table[byte][(bits >> (byte * 8)) & 0xff];
+	return out;
 }
 
 } // namespace cly::tas
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "server.h"
+#include "util.h"
 
 #include <atomic>
 
@@ -12,6 +13,10 @@
 
 #include "Library/Controller/NpadController.h"
 
+namespace sead {
+class AccelerometerAddon;
+} // namespace sead
+
 namespace cly::tas {
 
 enum Button : s32 {
@@ -54,40 +59,121 @@ struct ScriptHeader {
 class System {
 	SEAD_SINGLETON_DISPOSER(System);
 
+public:
+	// FramePacket::nextFrameIndex of a script's last frame
+	constexpr static u32 cNoNextFrame = 0xFFFFFFFF;
+	// FramePacket::player1 and player2
+	constexpr static s32 cPlayerNum = 2;
+	// one accelerometer per joycon
+	constexpr static s32 cAccelNum = 2;
+
+	// ScriptInfoPacket::controllerTypes: 0 for no controller, otherwise the npad style's bit index + 1
+	constexpr static u8 cControllerType_None = 0;
+	constexpr static u8 cControllerType_DualJoycons = 3;
+
+	// where a player's inputs get written to. a controller's addons live as long as it does,
+	// so they're only looked up when a different controller (or npad) turns up for that player
+	struct InjectTarget {
+		al::NpadController* controller = nullptr;
+		s32 npadId = -1;
+		sead::AccelerometerAddon* accel[cAccelNum] = {};
+	};
+
+	// stops and cached starts requested from other threads, handled by checkForNextFrame on the game thread
+	enum Request : u8 {
+		cRequest_Stop = 1 << 0,
+		cRequest_StartCached = 1 << 1,
+	};
+
+	// counters for the current (or last) replay, reset when a replay starts
+	struct Stats {
+		u32 appliedFrames = 0;
+		// game frames spent waiting on an empty frame buffer
+		u32 blockedFrames = 0;
+		// how many separate times the frame buffer ran dry
+		u32 underruns = 0;
+	};
+
 private:
 	sead::Heap* mHeap = nullptr;
 	Server::ScriptInfoPacket mScriptInfo;
+	// game frames played so far
 	u32 mFrameIdx = 0;
-	u32 mNextFrameIdx = 0;
+	// spans finished so far. each FramePacket is a span that holds its inputs from frameIndex until nextFrameIndex
+	u32 mSpanIdx = 0;
+	u32 mServerIdx = 0;
+	u32 mReplayId = 0;
+	// frames popped from the network frame buffer this replay, reported to the server as flow control credit
+	u32 mFramesReleased = 0;
 	bool mIsReplaying = false;
-	bool mHasCurFrame = false;
-	Server::FramePacket mCurFrame;
+	bool mIsPlayingFromCache = false;
+	// the current span, borrowed from the frame buffer until it ends and getNextFrame releases it back to the recv thread
+	const Server::FramePacket* mCurFrame = nullptr;
+	// the previous span, still held while waiting on the next one
 	Server::FramePacket mLastFrame;
+	Stats mStats;
+	InjectTarget mInjectTargets[cPlayerNum];
+	// Request bits not yet handled. a stop clears any cached start before it
+	std::atomic<u8> mRequests = 0;
+	// network replays are counted rather than flagged, so a start is pending until the game thread has caught up with it.
+	// starts requested before a stop are cancelled by it
+	std::atomic<u32> mStartsRequested = 0;
+	std::atomic<u32> mStartsCancelled = 0;
+	std::atomic<u32> mStartsHandled = 0;
+	std::atomic<u32> mRequestedReplayId = 0;
+
+	const Server::FramePacket* peekFrame();
+	void popFrame();
+	void resetReplay();
+	void handleRequests();
+
+	const InjectTarget& getInjectTarget(s32 player, al::NpadController* controller);
+	static void applyController(const InjectTarget& target, const Server::Controller& state, bool isDualJoycons);
 
 public:
 	System() = default;
 	void init(sead::Heap* heap);
-	static void startReplay();
+	static void startReplay(u32 replayId);
+	// plays a script file in the cache's format, by default the one the server cached
+	static void startCachedReplay(const char* path = nullptr);
 	static void stopReplay();
+	// the same, from any thread other than the game thread. they take effect on the next checkForNextFrame
+	static void requestStartReplay(u32 replayId);
+	static void requestStartCachedReplay();
+	static void requestStopReplay();
 	static void processInputs(al::NpadController* controller);
 
 	static bool isReplaying() { return instance()->mIsReplaying; }
 
+	static bool isPlayingFromCache() { return instance()->mIsPlayingFromCache; }
+
+	// the frame buffer is about to be reset for a new replay, so nothing can be written to it yet
+	static bool isStartPending();
+
 	static bool isApplyingInput();
 
 	static u32 getFrameIndex() { return instance()->mFrameIdx; };
 
-	static u32 getServerIndex() { return instance()->mCurFrame.serverIndex; };
+	static u32 getServerIndex() { return instance()->mServerIdx; };
+
+	static u32 getReplayId() { return instance()->mReplayId; }
+
+	static u32 getFramesReleased() { return instance()->mFramesReleased; }
+
+	static u32 getSpanIndex() { return instance()->mSpanIdx; };
 
+	// the number of spans in the script, not game frames
 	static u32 getFrameCount() { return instance()->mScriptInfo.frameCount; };
 
+	static const Stats& getStats() { return instance()->mStats; }
+
 	static void checkForNextFrame();
 	static void getNextFrame();
-	static Server::FramePacket tryReadCurFrame();
+	static const Server::FramePacket& tryReadCurFrame();
 
 	static void setScriptInfo(Server::ScriptInfoPacket scriptInfo) { instance()->mScriptInfo = scriptInfo; }
 
-	static bool isDualJoycons(s32 index) { return instance()->mScriptInfo.controllerTypes[index] == 3; }
+	static bool isDualJoycons(s32 index) { return instance()->mScriptInfo.controllerTypes[index] == cControllerType_DualJoycons; }
 };
 
 class Pauser {
@@ -99,10 +185,16 @@ private:
 	std::atomic_bool mWaitingOnLoad = false;
 	std::atomic<s32> mFrameAdvance = 0;
 	std::atomic<s32> mLoadDelay = 0;
+	// game frames run per drawn frame while replaying. 1 is normal speed
+	std::atomic<s32> mFastForward = 1;
 
 	bool isPaused() const { return mIsPaused || mIsBlocked; }
 
 public:
+	constexpr static s32 cFastForwardMax = 16;
+	// extra frames stop once this much of a 60fps frame has gone by, which leaves the rest of it for drawing
+	constexpr static u64 cFastForwardBudgetTicks = util::cSystemTickFrequency / 1000 * 12;
+
 	Pauser() = default;
 
 	bool isBlocked() const { return mIsBlocked; }
@@ -125,6 +217,21 @@ public:
 
 	bool isSequenceActive() const { return !isPaused() || isWaitingOnLoad() || (mFrameAdvance != 0); }
 
+	s32 getFastForward() const { return mFastForward; }
+
+	void setFastForward(s32 frames) { mFastForward = frames < 1 ? 1 : frames > cFastForwardMax ? cFastForwardMax : frames; }
+
+	// 1, 2, 4, ... cFastForwardMax, then back to 1
+	void cycleFastForward() { setFastForward(mFastForward >= cFastForwardMax ? 1 : mFastForward * 2); }
+
+	// whether GameSystem::movement can run again before the next draw, after running framesRun times in elapsedTicks since the last one.
+	// the next frame is assumed to take as long as the average so far
+	bool canRunExtraFrame(s32 framesRun, u64 elapsedTicks) const {
+		if (framesRun >= mFastForward || !System::isReplaying()) return false;
+		if (isPaused() || isWaitingOnLoad() || mFrameAdvance != 0) return false;
+		return elapsedTicks + elapsedTicks / framesRun <= cFastForwardBudgetTicks;
+	}
+
 	void update() {
 		if (mFrameAdvance > 0 && !mIsBlocked) {
 			mFrameAdvance--;
@@ -133,5 +240,7 @@ public:
 };
 
 sead::BitFlag32 convertButtonsSTASToSead(sead::BitFlag64 stasPad);
+// Start and Plus both map back to cSTAS_Plus
+sead::BitFlag64 convertButtonsSeadToSTAS(sead::BitFlag32 seadPad);
 
 } // namespace cly::tas
@@ -0,0 +1,78 @@
+#include "trace.h"
+#include "util.h"
+
+#include <cstdio>
+
+namespace cly::trace {
+
+namespace {
+
+static_assert((cRecordNumMax & (cRecordNumMax - 1)) == 0, "trace ring size must be a power of two");
+
+Record sRecords[cRecordNumMax];
+// free-running, only masked when addressing sRecords
+u32 sWriteIdx = 0;
+u32 sFlushIdx = 0;
+
+// log messages sent per flushToServer call. a message holds about 8 records, so a full ring takes around 8 calls
+constexpr s32 cFlushMessageNumMax = 4;
+
+} // namespace
+
+void push(const Server::FramePacket& frame) {
+	Record& record = sRecords[sWriteIdx & (cRecordNumMax - 1)];
+	record.tick = util::getSystemTick();
+	record.frameIndex = frame.frameIndex;
+	record.nextFrameIndex = frame.nextFrameIndex;
+	record.serverIndex = frame.serverIndex;
+	record.buttons = frame.player1.buttons;
+	record.leftStick = frame.player1.leftStick;
+	record.rightStick = frame.player1.rightStick;
+	sWriteIdx++;
+}
+
+u32 getRecordCount() {
+	return sWriteIdx;
+}
+
+bool getRecord(u32 age, Record* out) {
+	if (age >= sWriteIdx || age >= u32(cRecordNumMax)) return false;
+
+	*out = sRecords[(sWriteIdx - 1 - age) & (cRecordNumMax - 1)];
+	return true;
+}
+
+void format(const Record& record, sead::BufferedSafeString* out) {
+	out->format(
+		"%04d->%04d: %016lx %06d %06d", record.frameIndex, record.nextFrameIndex, record.buttons, record.leftStick.x, record.leftStick.y
+	);
+}
+
+void flushToServer() {
+	if (sFlushIdx == sWriteIdx || !Server::isConnected()) return;
+
+	// anything older than the ring has already been overwritten
+	if (sWriteIdx - sFlushIdx > u32(cRecordNumMax)) sFlushIdx = sWriteIdx - cRecordNumMax;
+
+	sead::FixedSafeString<128> line;
+	char text[Server::cLogTextSizeMax + 1];
+	for (s32 i = 0; i < cFlushMessageNumMax && sFlushIdx != sWriteIdx; i++) {
+		u32 textLen = 0;
+		u32 flushIdx = sFlushIdx;
+		for (; flushIdx != sWriteIdx; flushIdx++) {
+			const Record& record = sRecords[flushIdx & (cRecordNumMax - 1)];
+			format(record, &line);
+			const s32 len = snprintf(text + textLen, sizeof(text) - textLen, "%s[%lu] %s", textLen == 0 ? "" : "\n", record.tick, line.cstr());
+			if (len < 0 || textLen + len >= sizeof(text)) break;
+			textLen += len;
+		}
+		if (textLen == 0) return;
+		text[textLen] = '\0';
+
+		// the send queue is full, the rest will go out on a later call
+		if (!Server::log("%s", text)) return;
+		sFlushIdx = flushIdx;
+	}
+}
+
+} // namespace cly::trace
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "server.h"
+
+#include <hk/types.h>
+
+#include <sead/math/seadVector.h>
+#include <sead/prim/seadSafeString.h>
+
+// highest trace level that gets compiled in. anything above it compiles away entirely,
+// so the per-frame records can be turned off for release builds by passing -DCLY_TRACE_LEVEL=0
+#ifndef CLY_TRACE_LEVEL
+#define CLY_TRACE_LEVEL 1
+#endif
+
+namespace cly::trace {
+
+enum Level : s32 {
+	cLevel_Off = 0,
+	// one record per applied replay frame
+	cLevel_Frame = 1,
+};
+
+constexpr bool isEnabled(Level level) {
+	return level != cLevel_Off && level <= CLY_TRACE_LEVEL;
+}
+
+// fixed-size binary record. nothing is formatted until the record is drawn or flushed
+struct Record {
+	u64 tick;
+	u32 frameIndex;
+	u32 nextFrameIndex;
+	u32 serverIndex;
+	u64 buttons;
+	sead::Vector2i leftStick;
+	sead::Vector2i rightStick;
+};
+
+constexpr s32 cRecordNumMax = 256;
+
+void push(const Server::FramePacket& frame);
+
+// records are written from the scene movement hook and read from the menu draw,
+// both of which run on the main thread, so no synchronisation is needed
+template <Level L>
+inline void record(const Server::FramePacket& frame) {
+	if constexpr (isEnabled(L)) push(frame);
+}
+
+// number of records pushed since boot. only the last cRecordNumMax of them are kept
+u32 getRecordCount();
+// `age` 0 is the newest record. returns false if that record has been overwritten or never existed
+bool getRecord(u32 age, Record* out);
+
+void format(const Record& record, sead::BufferedSafeString* out);
+
+// sends records that haven't been sent yet to the server, packed several to a log message.
+// only a few messages go out per call, so a full ring is spread over a few frames instead of flooding the send queue.
+// game thread only, like push
+void flushToServer();
+
+} // namespace cly::trace
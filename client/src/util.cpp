@@ -22,7 +22,8 @@ hk::Result createFile(const sead::SafeString& filePath, s64 size, bool overwrite
 
 bool isFileExist(const sead::SafeString& filePath) {
 	nn::fs::DirectoryEntryType entryType;
-	nn::fs::GetEntryType(&entryType, filePath.cstr());
+	// entryType is left as it was when there's nothing there
+	if (nn::fs::GetEntryType(&entryType, filePath.cstr()).IsFailure()) return false;
 
 	return entryType == nn::fs::DirectoryEntryType_File;
 }
@@ -3,6 +3,10 @@
 #include <hk/container/StringView.h>
 #include <hk/gfx/Util.h>
 
+#if !defined(__aarch64__)
+#include <chrono>
+#endif
+
 #include <nn/types.h>
 #include <sead/prim/seadSafeString.h>
 
@@ -16,7 +20,7 @@
 	do {                                                                                                                                                       \
 		nn::Result _result = RESULT;                                                                                                                           \
 		if (_result.IsFailure()) {                                                                                                                             \
-			cly::Menu::log("ERROR: %s:%s (%04d-%04d)", __FILE__, __LINE__, _result.GetModule() + 2000, _result.GetDescription());                              \
+			cly::Menu::log("ERROR: %s:%d (%04d-%04d)", __FILE__, __LINE__, _result.GetModule() + 2000, _result.GetDescription());                              \
 			return _result.GetInnerValueForDebug();                                                                                                            \
 		}                                                                                                                                                      \
 	} while (0)
@@ -39,6 +43,26 @@ inline u32 roundUp(u32 x, u32 power_of_2) {
 	return (x + a) & ~a;
 }
 
+// the switch's system counter runs at a fixed 19.2MHz
+constexpr u64 cSystemTickFrequency = 19'200'000;
+
+inline u64 getSystemTick() {
+#if defined(__aarch64__)
+	u64 tick;
+	__asm__ volatile("mrs %0, cntpct_el0" : "=r"(tick));
+	return tick;
+#else
+	// host builds of the tests, scaled to the switch's frequency so tick arithmetic stays the same
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	// 19.2 ticks per microsecond doesn't divide evenly, so this scales the whole count, in 128 bits so it can't overflow
+	return u64((unsigned __int128)ns * cSystemTickFrequency / 1'000'000'000);
+#endif
+}
+
+inline u64 ticksToMicroseconds(u64 ticks) {
+	return ticks * 1'000'000 / cSystemTickFrequency;
+}
+
 template <typename T>
 const char* getTypeName(T* value) {
 	return typeid(*value).name();
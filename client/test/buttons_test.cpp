@@ -0,0 +1,132 @@
+#include "check.h"
+
+#include <sead/controller/seadController.h>
+
+#include "tas.h"
+
+using namespace cly;
+using namespace cly::tas;
+
+namespace {
+
+// convertButtonsSTASToSead as it was before the byte tables, kept verbatim as the reference
+sead::BitFlag32 convertButtonsSTASToSeadOld(sead::BitFlag64 stasPad) {
+	sead::BitFlag32 mask = 0;
+	for (s32 i = 0; i < 64; i++) {
+		if (stasPad.isOnBit(i)) {
+			if (i == cSTAS_A)
+				mask.setBit(sead::Controller::cPadIdx_A);
+			else if (i == cSTAS_B)
+				mask.setBit(sead::Controller::cPadIdx_B);
+			else if (i == cSTAS_X)
+				mask.setBit(sead::Controller::cPadIdx_X);
+			else if (i == cSTAS_Y)
+				mask.setBit(sead::Controller::cPadIdx_Y);
+			else if (i == cSTAS_LeftStick)
+				mask.setBit(sead::Controller::cPadIdx_1);
+			else if (i == cSTAS_RightStick)
+				mask.setBit(sead::Controller::cPadIdx_2);
+			else if (i == cSTAS_L)
+				mask.setBit(sead::Controller::cPadIdx_L);
+			else if (i == cSTAS_R)
+				mask.setBit(sead::Controller::cPadIdx_R);
+			else if (i == cSTAS_ZL)
+				mask.setBit(sead::Controller::cPadIdx_ZL);
+			else if (i == cSTAS_ZR)
+				mask.setBit(sead::Controller::cPadIdx_ZR);
+			else if (i == cSTAS_Plus) {
+				mask.setBit(sead::Controller::cPadIdx_Plus);
+				mask.setBit(sead::Controller::cPadIdx_Start);
+			} else if (i == cSTAS_Minus)
+				mask.setBit(sead::Controller::cPadIdx_Minus);
+			else if (i == cSTAS_DLeft)
+				mask.setBit(sead::Controller::cPadIdx_Left);
+			else if (i == cSTAS_DUp)
+				mask.setBit(sead::Controller::cPadIdx_Up);
+			else if (i == cSTAS_DRight)
+				mask.setBit(sead::Controller::cPadIdx_Right);
+			else if (i == cSTAS_DDown)
+				mask.setBit(sead::Controller::cPadIdx_Down);
+		}
+	}
+
+	return mask;
+}
+
+// the same mapping read backwards, one sead button at a time
+sead::BitFlag64 convertButtonsSeadToSTASReference(sead::BitFlag32 seadPad) {
+	sead::BitFlag64 mask = 0;
+	for (s32 i = 0; i < 32; i++) {
+		if (!seadPad.isOnBit(i)) continue;
+
+		switch (i) {
+		case sead::Controller::cPadIdx_A: mask.setBit(cSTAS_A); break;
+		case sead::Controller::cPadIdx_B: mask.setBit(cSTAS_B); break;
+		case sead::Controller::cPadIdx_X: mask.setBit(cSTAS_X); break;
+		case sead::Controller::cPadIdx_Y: mask.setBit(cSTAS_Y); break;
+		case sead::Controller::cPadIdx_1: mask.setBit(cSTAS_LeftStick); break;
+		case sead::Controller::cPadIdx_2: mask.setBit(cSTAS_RightStick); break;
+		case sead::Controller::cPadIdx_L: mask.setBit(cSTAS_L); break;
+		case sead::Controller::cPadIdx_R: mask.setBit(cSTAS_R); break;
+		case sead::Controller::cPadIdx_ZL: mask.setBit(cSTAS_ZL); break;
+		case sead::Controller::cPadIdx_ZR: mask.setBit(cSTAS_ZR); break;
+		case sead::Controller::cPadIdx_Plus:
+		case sead::Controller::cPadIdx_Start: mask.setBit(cSTAS_Plus); break;
+		case sead::Controller::cPadIdx_Minus: mask.setBit(cSTAS_Minus); break;
+		case sead::Controller::cPadIdx_Left: mask.setBit(cSTAS_DLeft); break;
+		case sead::Controller::cPadIdx_Up: mask.setBit(cSTAS_DUp); break;
+		case sead::Controller::cPadIdx_Right: mask.setBit(cSTAS_DRight); break;
+		case sead::Controller::cPadIdx_Down: mask.setBit(cSTAS_DDown); break;
+		default: break;
+		}
+	}
+
+	return mask;
+}
+
+// bits above the 16 STAS buttons mean nothing, and have to stay that way
+constexpr u64 cHighPatterns[] = { 0, ~u64(0xFFFF), 0xA5A5A5A5A5A50000, u64(1) << 16, u64(1) << 63 };
+
+void testSTASToSead() {
+	for (u64 high : cHighPatterns) {
+		for (u32 buttons = 0; buttons < 0x10000; buttons++) {
+			const u64 stas = high | buttons;
+			CHECK(convertButtonsSTASToSead(stas).getDirect() == convertButtonsSTASToSeadOld(stas).getDirect());
+		}
+	}
+}
+
+void testSeadToSTAS() {
+	// every combination of the low 20 bits, which hold every button STAS has a mapping for, with a few patterns above them
+	constexpr u32 cSeadHighPatterns[] = { 0, ~u32(0xFFFFF), 0x5A500000 };
+	for (u32 high : cSeadHighPatterns) {
+		for (u32 buttons = 0; buttons < (1u << 20); buttons++) {
+			const u32 sead = high | buttons;
+			CHECK(convertButtonsSeadToSTAS(sead).getDirect() == convertButtonsSeadToSTASReference(sead).getDirect());
+		}
+	}
+}
+
+// a recording converts the pad back to STAS, and a replay of it converts that to sead again,
+// so every STAS mask has to survive the trip there and back
+void testRoundTrip() {
+	for (u32 stas = 0; stas < 0x10000; stas++) {
+		const sead::BitFlag32 sead = convertButtonsSTASToSead(stas);
+		CHECK(convertButtonsSeadToSTAS(sead).getDirect() == stas);
+	}
+
+	// Start on its own records as Plus, which replays as both
+	const u32 start = 1u << sead::Controller::cPadIdx_Start;
+	const u32 plusStart = start | 1u << sead::Controller::cPadIdx_Plus;
+	CHECK(convertButtonsSeadToSTAS(start).getDirect() == 1u << cSTAS_Plus);
+	CHECK(convertButtonsSTASToSead(convertButtonsSeadToSTAS(start)).getDirect() == plusStart);
+}
+
+} // namespace
+
+int main() {
+	testSTASToSead();
+	testSeadToSTAS();
+	testRoundTrip();
+	return 0;
+}
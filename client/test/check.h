@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// every host test is a plain executable that aborts on the first failed check, so ctest reports it
+#define CHECK(EXPR)                                                                                                                                            \
+	do {                                                                                                                                                       \
+		if (!(EXPR)) {                                                                                                                                         \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #EXPR);                                                                      \
+			std::abort();                                                                                                                                      \
+		}                                                                                                                                                      \
+	} while (0)
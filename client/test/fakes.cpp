@@ -0,0 +1,94 @@
+#include "fakes.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "main.h"
+#include "menu.h"
+#include "recorder.h"
+#include "scriptcache.h"
+#include "server.h"
+#include "tas.h"
+
+// the console-only parts of the client that the sources under test call into. each does the least it can:
+// nothing here talks to a socket or the renderer. the script cache is the real one, on the nn::fs stand-in in stub/nn/fs.h.
+// set CLY_TEST_VERBOSE to see what would have been logged
+
+namespace cly {
+
+bool gIsInitialized = true;
+
+SEAD_SINGLETON_DISPOSER_IMPL(Menu);
+SEAD_SINGLETON_DISPOSER_IMPL(Server);
+
+namespace {
+
+void printLog(const char* prefix, const char* fmt, va_list args) {
+	static const bool sIsVerbose = getenv("CLY_TEST_VERBOSE") != nullptr;
+	if (!sIsVerbose) return;
+
+	fputs(prefix, stdout);
+	vprintf(fmt, args);
+	fputc('\n', stdout);
+}
+
+} // namespace
+
+void Menu::log(const char* fmt, ...) {
+	test::gFakes.menuLogs++;
+	va_list args;
+	va_start(args, fmt);
+	printLog("menu: ", fmt, args);
+	va_end(args);
+}
+
+void Menu::handleInput(sead::BitFlag32 padHold) {
+	mPrevHold = padHold;
+}
+
+bool Server::log(const char* fmt, ...) {
+	test::gFakes.serverLogs++;
+	va_list args;
+	va_start(args, fmt);
+	printLog("server: ", fmt, args);
+	va_end(args);
+	return true;
+}
+
+void Server::reportScriptCompleted() {
+	test::gFakes.scriptsCompleted++;
+}
+
+namespace tas {
+
+SEAD_SINGLETON_DISPOSER_IMPL(Recorder);
+
+void Recorder::capture(s32, const System::InjectTarget&) {}
+
+} // namespace tas
+
+namespace test {
+
+Fakes gFakes;
+
+void resetFakes() {
+	Menu::deleteInstance();
+	Server::deleteInstance();
+	ScriptCache::deleteInstance();
+	tas::Recorder::deleteInstance();
+	tas::System::deleteInstance();
+	tas::Pauser::deleteInstance();
+
+	Menu::createInstance(nullptr);
+	Server::createInstance(nullptr);
+	ScriptCache::createInstance(nullptr)->init(nullptr);
+	tas::Recorder::createInstance(nullptr);
+	tas::System::createInstance(nullptr);
+	tas::Pauser::createInstance(nullptr);
+	gFakes = {};
+}
+
+} // namespace test
+
+} // namespace cly
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace cly::test {
+
+// what the stand-ins in fakes.cpp have been asked to do, so tests can check the code under test called out correctly
+struct Fakes {
+	s32 menuLogs = 0;
+	s32 serverLogs = 0;
+	s32 scriptsCompleted = 0;
+};
+
+extern Fakes gFakes;
+
+// (re)creates every singleton the code under test reaches for, and clears gFakes.
+// a cached replay has to have been stopped and its thread finished first
+void resetFakes();
+
+} // namespace cly::test
@@ -0,0 +1,236 @@
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "framedelta.h"
+#include "server.h"
+#include "tas.h"
+
+// round trips frames through the console's own framedelta::Encoder and Decoder, and pins both to the bytes the server's
+// encoder produces for the same frames (server/src/server/frame_delta.rs checks the same packet), so the two can't drift apart
+
+using namespace cly;
+using FramePacket = Server::FramePacket;
+
+namespace {
+
+struct Rng {
+	u64 state;
+
+	u32 next() {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		return u32(state >> 32);
+	}
+
+	u32 below(u32 n) { return next() % n; }
+};
+
+// the frames of cGoldenPacket: a held input, a frame where every field of both players changes, and the script's last frame
+std::vector<FramePacket> makeGoldenFrames() {
+	FramePacket frame = {};
+	frame.frameIndex = 5;
+	frame.nextFrameIndex = 205;
+	frame.serverIndex = 10;
+	frame.player1.buttons = 0x41;
+	frame.player1.leftStick = { 100, -200 };
+
+	std::vector<FramePacket> frames = { frame };
+
+	frame.frameIndex = 205;
+	frame.nextFrameIndex = 206;
+	frame.serverIndex = 11;
+	frame.player1 = {
+		.buttons = 0x8000000000000002,
+		.leftStick = { -32768, 32767 },
+		.rightStick = { 1, -1 },
+		.accelLeft = { 0.5f, -1.0f, 2.0f },
+		.accelRight = { 1.0f, 1.0f, 1.0f },
+	};
+	frame.player2 = {
+		.buttons = 0x10,
+		.leftStick = { 7, 8 },
+		.rightStick = { -9, 10 },
+		.accelLeft = { 0.0f, 0.0f, -1.0f },
+		.accelRight = { -1.0f, 0.0f, 0.0f },
+	};
+	frame.amiibo = 0x0123456789ABCDEF;
+	frames.push_back(frame);
+
+	frame.frameIndex = 206;
+	frame.nextFrameIndex = tas::System::cNoNextFrame;
+	frame.serverIndex = 12;
+	frame.player1.buttons = 0;
+	frames.push_back(frame);
+
+	return frames;
+}
+
+// keep in sync with GOLDEN_PACKET in server/src/server/frame_delta.rs
+constexpr u8 cGoldenPacket[] = {
+	0x0a, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x03, 0x00, 0x03, 0x00, 0xc8, 0x01, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00,
+	0x00, 0x38, 0xff, 0xff, 0xff, 0xff, 0x07, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x80, 0xff, 0xff, 0xff, 0x7f, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x80, 0xbf, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x80, 0x3f, 0x00, 0x00,
+	0x80, 0x3f, 0x00, 0x00, 0x80, 0x3f, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0xf7, 0xff, 0xff,
+	0xff, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xbf, 0x00, 0x00, 0x80, 0xbf, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// encodes `frames` into one packet, returning its bytes
+std::vector<u8> encode(const std::vector<FramePacket>& frames) {
+	std::vector<u8> buf(sizeof(framedelta::Header) + framedelta::cMaxRecordSize * frames.size());
+	framedelta::Encoder encoder;
+	encoder.init(buf.data(), buf.size(), frames[0].serverIndex, frames[0].frameIndex);
+	for (const FramePacket& frame : frames)
+		CHECK(encoder.push(frame));
+	CHECK(encoder.getCount() == frames.size());
+
+	buf.resize(encoder.finish());
+	return buf;
+}
+
+// decodes `packet` and checks it holds exactly `frames`, byte for byte
+void checkDecodes(const u8* packet, u32 size, const std::vector<FramePacket>& frames) {
+	framedelta::Decoder decoder;
+	CHECK(decoder.init(packet, size));
+	CHECK(decoder.getRemaining() == frames.size());
+
+	for (const FramePacket& expected : frames) {
+		CHECK(decoder.getNextServerIndex() == expected.serverIndex);
+		FramePacket decoded;
+		memset(&decoded, 0xCC, sizeof(decoded));
+		CHECK(decoder.next(&decoded));
+		CHECK(memcmp(&decoded, &expected, sizeof(FramePacket)) == 0);
+	}
+
+	FramePacket extra;
+	CHECK(decoder.getRemaining() == 0);
+	CHECK(!decoder.next(&extra));
+}
+
+void testGoldenPacket() {
+	const std::vector<FramePacket> frames = makeGoldenFrames();
+	const std::vector<u8> packet = encode(frames);
+	CHECK(packet.size() == sizeof(cGoldenPacket));
+	CHECK(memcmp(packet.data(), cGoldenPacket, sizeof(cGoldenPacket)) == 0);
+	checkDecodes(cGoldenPacket, sizeof(cGoldenPacket), frames);
+}
+
+void testEveryField() {
+	// each field changing on its own, and then back
+	std::vector<FramePacket> frames;
+	FramePacket frame = {};
+	for (s32 i = 0; i < framedelta::cFieldNum * 2; i++) {
+		const framedelta::Field& field = framedelta::cFields[i % framedelta::cFieldNum];
+		frame.frameIndex = i;
+		frame.nextFrameIndex = i + 1;
+		frame.serverIndex = 100 + i;
+		memset(cast<u8*>(&frame) + field.offset, i < framedelta::cFieldNum ? 0xA5 : 0, field.size);
+		frames.push_back(frame);
+	}
+	frames.back().nextFrameIndex = tas::System::cNoNextFrame;
+
+	const std::vector<u8> packet = encode(frames);
+	checkDecodes(packet.data(), packet.size(), frames);
+}
+
+Server::Controller makeController(Rng& rng, const Server::Controller& prev) {
+	// most frames hold the inputs of the one before, which is what the delta relies on
+	Server::Controller controller = prev;
+	if (rng.below(2) == 0) controller.buttons = u64(rng.next()) << 32 | rng.next();
+	if (rng.below(3) == 0) controller.leftStick = { s32(rng.next()), s32(rng.next()) };
+	if (rng.below(3) == 0) controller.rightStick = { s32(rng.next()), s32(rng.next()) };
+	if (rng.below(4) == 0) controller.accelLeft = { f32(rng.below(200)) / 100, f32(rng.below(200)) / -100, 1.0f };
+	if (rng.below(4) == 0) controller.accelRight = { 1.0f, f32(rng.below(200)) / 100, f32(rng.below(7)) };
+	return controller;
+}
+
+void testRandomSpans(u64 seed) {
+	Rng rng = { seed };
+	FramePacket frame = {};
+	u32 frameIndex = rng.below(1000);
+
+	std::vector<FramePacket> frames;
+	for (s32 i = 0; i < 200; i++) {
+		frame.frameIndex = frameIndex;
+		// spans held for a single frame, for a while, and for longer than a one byte varint can say
+		switch (rng.below(8)) {
+		case 0: frameIndex += 1 + rng.below(1 << 20); break;
+		case 1:
+		case 2: frameIndex += 2 + rng.below(100); break;
+		default: frameIndex++;
+		}
+		frame.nextFrameIndex = frameIndex;
+		frame.serverIndex = u32(seed) + i;
+
+		if (rng.below(4) != 0) frame.player1 = makeController(rng, frame.player1);
+		if (rng.below(2) == 0) frame.player2 = makeController(rng, frame.player2);
+		if (rng.below(20) == 0) frame.amiibo = u64(rng.next()) << 32 | rng.next();
+		frames.push_back(frame);
+	}
+	frames.back().nextFrameIndex = tas::System::cNoNextFrame;
+
+	// in packets of several sizes, each of which has to decode on its own
+	for (u32 batch : { 1u, 7u, 64u, 200u }) {
+		for (u32 start = 0; start < frames.size(); start += batch) {
+			const std::vector<FramePacket> packetFrames(frames.begin() + start, frames.begin() + std::min<u32>(start + batch, frames.size()));
+			const std::vector<u8> packet = encode(packetFrames);
+			checkDecodes(packet.data(), packet.size(), packetFrames);
+		}
+	}
+}
+
+void testEncoderFull() {
+	const std::vector<FramePacket> frames = makeGoldenFrames();
+
+	// room for the header and two worst case records only
+	u8 buf[sizeof(framedelta::Header) + framedelta::cMaxRecordSize * 2];
+	framedelta::Encoder encoder;
+	encoder.init(buf, sizeof(buf), frames[0].serverIndex, frames[0].frameIndex);
+	CHECK(encoder.push(frames[0]));
+	CHECK(encoder.push(frames[1]));
+	CHECK(!encoder.push(frames[2]));
+	const u32 size = encoder.finish();
+	checkDecodes(buf, size, { frames[0], frames[1] });
+}
+
+void testMalformed() {
+	framedelta::Decoder decoder;
+	CHECK(!decoder.init(cGoldenPacket, sizeof(framedelta::Header) - 1));
+
+	// every truncation of the packet decodes the whole records it still holds, then stops
+	const std::vector<FramePacket> frames = makeGoldenFrames();
+	for (u32 size = sizeof(framedelta::Header); size < sizeof(cGoldenPacket); size++) {
+		CHECK(decoder.init(cGoldenPacket, size));
+		FramePacket decoded;
+		u32 count = 0;
+		while (decoder.next(&decoded)) {
+			CHECK(memcmp(&decoded, &frames[count], sizeof(FramePacket)) == 0);
+			count++;
+		}
+		CHECK(count < frames.size());
+		CHECK(decoder.getRemaining() == frames.size() - count);
+	}
+
+	// a run length that never ends
+	u8 packet[sizeof(framedelta::Header) + 2 + framedelta::cMaxVarIntSize];
+	memcpy(packet, cGoldenPacket, sizeof(framedelta::Header));
+	memset(packet + sizeof(framedelta::Header), 0, 2);
+	memset(packet + sizeof(framedelta::Header) + 2, 0xFF, framedelta::cMaxVarIntSize);
+	FramePacket decoded;
+	CHECK(decoder.init(packet, sizeof(packet)));
+	CHECK(!decoder.next(&decoded));
+}
+
+} // namespace
+
+int main() {
+	testGoldenPacket();
+	testEveryField();
+	for (u64 seed = 1; seed <= 16; seed++)
+		testRandomSpans(seed);
+	testEncoderFull();
+	testMalformed();
+	return 0;
+}
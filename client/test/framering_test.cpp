@@ -0,0 +1,126 @@
+#include "check.h"
+#include "framering.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace cly;
+
+namespace {
+
+// roughly the size of a FramePacket, so the ring moves as much memory per frame as it does on the console
+struct Frame {
+	u32 index;
+	u32 payload[31];
+};
+
+void fill(Frame* frame, u32 index) {
+	frame->index = index;
+	for (u32 i = 0; i < 31; i++)
+		frame->payload[i] = index * 2654435761u + i;
+}
+
+bool isIntact(const Frame& frame, u32 index) {
+	if (frame.index != index) return false;
+	for (u32 i = 0; i < 31; i++)
+		if (frame.payload[i] != index * 2654435761u + i) return false;
+	return true;
+}
+
+void testSingleThread() {
+	FrameRing<Frame, 4> ring;
+	CHECK(ring.peek() == nullptr);
+	CHECK(ring.size() == 0);
+
+	for (u32 i = 0; i < 4; i++) {
+		Frame* frame = ring.beginWrite();
+		CHECK(frame != nullptr);
+		fill(frame, i);
+		ring.endWrite();
+	}
+	CHECK(ring.isFull());
+	CHECK(ring.beginWrite() == nullptr);
+
+	for (u32 i = 0; i < 2; i++) {
+		const Frame* frame = ring.peek();
+		CHECK(frame && isIntact(*frame, i));
+		ring.pop();
+	}
+
+	// two slots are free, but only up to the end of the buffer before wrapping
+	u32 count = 4;
+	Frame* frames = ring.beginWrite(count);
+	CHECK(frames != nullptr && count == 2);
+	fill(&frames[0], 4);
+	fill(&frames[1], 5);
+	ring.endWrite(count);
+
+	for (u32 i = 2; i < 6; i++) {
+		const Frame* frame = ring.peek();
+		CHECK(frame && isIntact(*frame, i));
+		ring.pop();
+	}
+	CHECK(ring.peek() == nullptr);
+
+	fill(ring.beginWrite(), 6);
+	ring.endWrite();
+	ring.clear();
+	CHECK(ring.peek() == nullptr);
+	CHECK(ring.size() == 0);
+}
+
+// the recv thread writes bursts of frames as packets arrive while the game thread drains one per frame.
+// both sides run flat out here, with deterministic but uneven burst sizes, so every wrap and full/empty edge gets hit.
+// each side yields when it can't make progress, otherwise a single-core CI runner spends whole timeslices spinning
+void testStress() {
+	constexpr u32 cFrameNum = 20'000'000;
+	FrameRing<Frame, 64> ring;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::thread producer([&ring] {
+		u32 seed = 1;
+		for (u32 next = 0; next < cFrameNum;) {
+			seed = seed * 1664525 + 1013904223;
+			u32 count = (seed >> 24) % 8 + 1;
+			if (count > cFrameNum - next) count = cFrameNum - next;
+
+			Frame* frames = ring.beginWrite(count);
+			if (!frames) {
+				std::this_thread::yield();
+				continue;
+			}
+			for (u32 i = 0; i < count; i++)
+				fill(&frames[i], next + i);
+			ring.endWrite(count);
+			next += count;
+		}
+	});
+
+	for (u32 expected = 0; expected < cFrameNum;) {
+		const Frame* frame = ring.peek();
+		if (!frame) {
+			std::this_thread::yield();
+			continue;
+		}
+		CHECK(isIntact(*frame, expected));
+		CHECK(ring.size() <= u32(ring.capacity));
+		ring.pop();
+		expected++;
+	}
+
+	producer.join();
+	CHECK(ring.peek() == nullptr);
+
+	const f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	std::printf("%u frames in %.2fs (%.1fM frames/s)\n", cFrameNum, seconds, cFrameNum / seconds / 1e6);
+}
+
+} // namespace
+
+int main() {
+	testSingleThread();
+	testStress();
+	return 0;
+}
@@ -0,0 +1,190 @@
+#include "check.h"
+#include "fakes.h"
+
+#include "Library/Camera/CameraTargetBase.h"
+#include "Library/LiveActor/LiveActor.h"
+#include "Library/Nerve/Nerve.h"
+#include "Library/Scene/Scene.h"
+
+#include "savestate.h"
+#include "tas.h"
+
+// drives SaveStates through its menu requests against a stand-in actor that only has a pose and a nerve,
+// in a stand-in scene whose camera is only a target
+
+using namespace cly;
+
+namespace {
+
+// a pose no other seed produces, so a restore from the wrong slot can't pass by accident
+void setPose(al::LiveActor* actor, s32 seed) {
+	const f32 f = f32(seed);
+	actor->mTrans = { f, f + 0.25f, f + 0.5f };
+	actor->mQuat = { f * 0.01f, 0.0f, 0.0f, 1.0f };
+	actor->mVelocity = { -f, 2.0f, f * 3.0f };
+	actor->mGravity = { 0.0f, -1.0f, f * 0.001f };
+}
+
+bool isPose(const al::LiveActor& actor, s32 seed) {
+	al::LiveActor expected;
+	setPose(&expected, seed);
+	return actor.mTrans.x == expected.mTrans.x && actor.mTrans.y == expected.mTrans.y && actor.mTrans.z == expected.mTrans.z &&
+		actor.mQuat.x == expected.mQuat.x && actor.mQuat.w == expected.mQuat.w && actor.mVelocity.x == expected.mVelocity.x &&
+		actor.mVelocity.z == expected.mVelocity.z && actor.mGravity.y == expected.mGravity.y && actor.mGravity.z == expected.mGravity.z;
+}
+
+void reset() {
+	test::resetFakes();
+	SaveStates::deleteInstance();
+	SaveStates::createInstance(nullptr);
+}
+
+void save(al::Scene* scene) {
+	SaveStates::requestSave();
+	SaveStates::update(scene);
+}
+
+void load(al::Scene* scene) {
+	SaveStates::requestLoad();
+	SaveStates::update(scene);
+}
+
+void testRoundTrip() {
+	reset();
+	al::LiveActor player;
+	al::Scene scene = { &player };
+
+	setPose(&player, 1);
+	save(&scene);
+	setPose(&player, 2);
+	CHECK(!isPose(player, 1));
+	load(&scene);
+	CHECK(isPose(player, 1));
+
+	// loading doesn't use the snapshot up
+	setPose(&player, 3);
+	load(&scene);
+	CHECK(isPose(player, 1));
+}
+
+void testRequests() {
+	reset();
+	al::LiveActor player;
+	al::Scene scene = { &player };
+
+	// nothing happens until the scene update carries the request out
+	setPose(&player, 1);
+	SaveStates::requestSave();
+	setPose(&player, 2);
+	SaveStates::update(&scene);
+	setPose(&player, 3);
+	load(&scene);
+	CHECK(isPose(player, 2));
+
+	// only the latest request counts, and it's only carried out once
+	setPose(&player, 4);
+	SaveStates::requestLoad();
+	SaveStates::requestSave();
+	SaveStates::update(&scene);
+	setPose(&player, 5);
+	SaveStates::update(&scene);
+	CHECK(isPose(player, 5));
+	load(&scene);
+	CHECK(isPose(player, 4));
+}
+
+void testSlots() {
+	reset();
+	al::LiveActor player;
+	al::Scene scene = { &player };
+
+	// more saves than slots. the newest is the one that loads, whichever slot it wrapped around to
+	for (s32 i = 0; i < SaveStates::cSlotNum * 2 + 3; i++) {
+		setPose(&player, 100 + i);
+		save(&scene);
+		setPose(&player, -1);
+		load(&scene);
+		CHECK(isPose(player, 100 + i));
+	}
+}
+
+struct NrvA : al::Nerve {};
+struct NrvB : al::Nerve {};
+
+void testNerveAndCamera() {
+	reset();
+	const NrvA nrvA;
+	const NrvB nrvB;
+	al::CameraTargetBase targetA;
+	al::CameraTargetBase targetB;
+	al::LiveActor player;
+	al::Scene scene = { &player };
+
+	player.mNerve = &nrvA;
+	scene.mCameraTarget = &targetA;
+	save(&scene);
+	player.mNerve = &nrvB;
+	scene.mCameraTarget = &targetB;
+	load(&scene);
+	CHECK(player.mNerve == &nrvA);
+	CHECK(scene.mCameraTarget == &targetA);
+	CHECK(scene.mCameraInterpoleCancels == 1);
+
+	// a snapshot taken without a camera target leaves the current one alone
+	scene.mCameraTarget = nullptr;
+	save(&scene);
+	scene.mCameraTarget = &targetB;
+	load(&scene);
+	CHECK(scene.mCameraTarget == &targetB);
+
+	// the scene's camera targets are gone once the next one starts, but the nerve and the pose still load
+	scene.mCameraTarget = &targetA;
+	player.mNerve = &nrvA;
+	setPose(&player, 1);
+	save(&scene);
+	SaveStates::handleSceneInit();
+	al::Scene nextScene = { &player };
+	nextScene.mCameraTarget = &targetB;
+	player.mNerve = &nrvB;
+	setPose(&player, 2);
+	load(&nextScene);
+	CHECK(nextScene.mCameraTarget == &targetB);
+	CHECK(player.mNerve == &nrvA);
+	CHECK(isPose(player, 1));
+}
+
+void testNothingToDo() {
+	reset();
+	al::LiveActor player;
+	al::Scene scene = { &player };
+
+	// no snapshot yet
+	setPose(&player, 1);
+	load(&scene);
+	CHECK(isPose(player, 1));
+	CHECK(test::gFakes.menuLogs == 1);
+
+	// no player, e.g. between stages. the request is dropped rather than held on to
+	al::Scene empty;
+	save(&empty);
+	CHECK(test::gFakes.menuLogs == 2);
+	load(&scene);
+	CHECK(isPose(player, 1));
+
+	save(&scene);
+	setPose(&player, 2);
+	load(&empty);
+	SaveStates::update(&scene);
+	CHECK(isPose(player, 2));
+}
+
+} // namespace
+
+int main() {
+	testRoundTrip();
+	testRequests();
+	testSlots();
+	testNerveAndCamera();
+	testNothingToDo();
+	return 0;
+}
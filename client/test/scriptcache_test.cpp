@@ -0,0 +1,256 @@
+#include "check.h"
+#include "fakes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <nn/fs.h>
+
+#include "framedelta.h"
+#include "scriptcache.h"
+#include "server.h"
+#include "tas.h"
+
+// caches scripts through ScriptCache on the nn::fs stand-in, in a scratch directory, and plays them back:
+// straight out of the chunk reader, and through tas::System the way a cached replay runs.
+// the cache thread is a real thread here, so playback waits on it like the game does
+
+using namespace cly;
+using FramePacket = Server::FramePacket;
+using tas::Pauser;
+using tas::System;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// far longer than the cache thread needs to catch up, even on a slow machine
+constexpr auto cTimeout = std::chrono::seconds(10);
+constexpr auto cPollInterval = std::chrono::microseconds(100);
+
+// enough spans for the double buffer to be refilled many times over
+constexpr u32 cSpanNum = 1000;
+
+struct Rng {
+	u64 state;
+
+	u32 next() {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		return u32(state >> 32);
+	}
+
+	u32 below(u32 n) { return next() % n; }
+};
+
+enum class Damage {
+	None,
+	// one block loses its last byte, so its last frame can't be decoded
+	TruncatedBlock,
+	// the file ends partway through a block
+	TruncatedFile,
+};
+
+Server::Controller makeController(Rng& rng) {
+	Server::Controller controller = {};
+	controller.buttons = rng.next() & 0xFFFF;
+	controller.leftStick = { s32(rng.below(65535)) - 32767, s32(rng.below(65535)) - 32767 };
+	controller.rightStick = { s32(rng.below(65535)) - 32767, 0 };
+	controller.accelLeft = { f32(rng.below(100)), 0.0f, 1.0f };
+	controller.accelRight = { 0.0f, f32(rng.below(100)), -1.0f };
+	return controller;
+}
+
+std::vector<FramePacket> makeScript(Rng& rng) {
+	std::vector<FramePacket> spans(cSpanNum);
+	u32 frame = rng.below(5);
+	for (u32 i = 0; i < cSpanNum; i++) {
+		FramePacket& span = spans[i];
+		memset(&span, 0, sizeof(span));
+		span.serverIndex = i;
+		span.frameIndex = frame;
+		span.player1 = makeController(rng);
+		span.player2 = rng.below(2) ? makeController(rng) : spans[i > 0 ? i - 1 : 0].player2;
+		if (rng.below(50) == 0) span.amiibo = u64(rng.next()) << 32 | rng.next();
+
+		frame += rng.below(4) != 0 ? 1 : 2 + rng.below(6);
+		span.nextFrameIndex = i + 1 < cSpanNum ? frame : System::cNoNextFrame;
+	}
+	return spans;
+}
+
+Server::ScriptInfoPacket makeScriptInfo() {
+	return { .frameCount = cSpanNum, .playerCount = 2, .controllerTypes = { 1, System::cControllerType_DualJoycons } };
+}
+
+// uploads `spans` the way the recv thread does for CacheBegin, CacheBlock and CacheEnd, `blockFrames` spans to a block.
+// returns how many spans are in the blocks before the damaged one
+u32 writeCache(const std::vector<FramePacket>& spans, u32 blockFrames, Damage damage) {
+	ScriptCache* cache = ScriptCache::instance();
+	CHECK(cache->beginWrite(makeScriptInfo()).succeeded());
+
+	const u32 damagedBlock = 3;
+	u32 undamagedSpans = spans.size();
+	s64 damagedFileSize = 0;
+
+	s64 fileSize = sizeof(u32) * 4 + sizeof(Server::ScriptInfoPacket);
+	for (u32 start = 0, block = 0; start < spans.size(); start += blockFrames, block++) {
+		u8 buf[ScriptCache::cBlockSizeMax];
+		framedelta::Encoder encoder;
+		encoder.init(buf, sizeof(buf), spans[start].serverIndex, spans[start].frameIndex);
+		for (u32 i = start; i < start + blockFrames && i < spans.size(); i++)
+			CHECK(encoder.push(spans[i]));
+		u32 size = encoder.finish();
+
+		if (block == damagedBlock && damage != Damage::None) {
+			undamagedSpans = start;
+			if (damage == Damage::TruncatedBlock) size--;
+			damagedFileSize = fileSize + sizeof(u32) + size / 2;
+		}
+
+		CHECK(cache->writeBlock(buf, size).succeeded());
+		fileSize += sizeof(u32) + size;
+	}
+
+	CHECK(cache->endWrite().succeeded());
+
+	if (damage == Damage::TruncatedFile) CHECK(truncate(nn::fs::host::getPath(ScriptCache::cFilePath).c_str(), damagedFileSize) == 0);
+	return undamagedSpans;
+}
+
+// the cache thread of the previous playback may still be on its way out, so this retries until it has finished
+void startStreaming(Server::ScriptInfoPacket* scriptInfo) {
+	const Clock::time_point deadline = Clock::now() + cTimeout;
+	while (!ScriptCache::instance()->startStreaming(scriptInfo)) {
+		CHECK(Clock::now() < deadline);
+		std::this_thread::sleep_for(cPollInterval);
+	}
+}
+
+// every span comes out of the chunk reader exactly as it went into the cache
+void testChunkReader(u64 seed, u32 blockFrames) {
+	Rng rng = { seed };
+	const std::vector<FramePacket> spans = makeScript(rng);
+	writeCache(spans, blockFrames, Damage::None);
+
+	ScriptCache* cache = ScriptCache::instance();
+	Server::ScriptInfoPacket scriptInfo;
+	startStreaming(&scriptInfo);
+	const Server::ScriptInfoPacket expectedInfo = makeScriptInfo();
+	CHECK(memcmp(&scriptInfo, &expectedInfo, sizeof(scriptInfo)) == 0);
+
+	for (const FramePacket& expected : spans) {
+		const Clock::time_point deadline = Clock::now() + cTimeout;
+		const FramePacket* frame;
+		while (!(frame = cache->peek())) {
+			CHECK(Clock::now() < deadline);
+			std::this_thread::sleep_for(cPollInterval);
+		}
+		CHECK(memcmp(frame, &expected, sizeof(FramePacket)) == 0);
+		cache->pop();
+	}
+
+	CHECK(cache->peek() == nullptr);
+	cache->stopStreaming();
+}
+
+// a cached replay through tas::System, one game frame at a time.
+// returns the spans it played, in order, along with whether the script ran to its end
+std::vector<FramePacket> playCachedReplay(bool* isCompleted) {
+	const s32 completedBefore = test::gFakes.scriptsCompleted;
+	const Clock::time_point deadline = Clock::now() + cTimeout;
+	while (!System::isReplaying()) {
+		CHECK(Clock::now() < deadline);
+		std::this_thread::sleep_for(cPollInterval);
+		System::requestStartCachedReplay();
+		System::checkForNextFrame();
+	}
+	CHECK(System::isPlayingFromCache());
+
+	std::vector<FramePacket> played;
+	while (true) {
+		CHECK(Clock::now() < deadline);
+
+		System::checkForNextFrame();
+		if (!System::isReplaying()) break;
+		if (Pauser::instance()->isBlocked()) {
+			std::this_thread::sleep_for(cPollInterval);
+			continue;
+		}
+
+		const u32 spanIdx = System::getSpanIndex();
+		System::getNextFrame();
+		// the span that just ended is left behind as the last frame
+		if (System::getSpanIndex() != spanIdx) played.push_back(System::tryReadCurFrame());
+	}
+
+	*isCompleted = test::gFakes.scriptsCompleted != completedBefore;
+	return played;
+}
+
+void testReplay(u64 seed, Damage damage) {
+	Rng rng = { seed };
+	const std::vector<FramePacket> spans = makeScript(rng);
+	const u32 undamagedSpans = writeCache(spans, 50, damage);
+
+	bool isCompleted;
+	const std::vector<FramePacket> played = playCachedReplay(&isCompleted);
+
+	// a damaged cache plays everything before the damage and nothing from the block it's in, then stops
+	CHECK(isCompleted == (damage == Damage::None));
+	CHECK(played.size() == undamagedSpans);
+	for (u32 i = 0; i < played.size(); i++)
+		CHECK(memcmp(&played[i], &spans[i], sizeof(FramePacket)) == 0);
+
+	CHECK(!Pauser::instance()->isBlocked());
+}
+
+// none of these can be played. run before anything else has started the cache thread, so only the file decides
+void testInvalidFiles() {
+	ScriptCache* cache = ScriptCache::instance();
+	Server::ScriptInfoPacket scriptInfo;
+
+	CHECK(!cache->startStreaming(&scriptInfo, "sd:/missing.bin"));
+
+	const std::string path = nn::fs::host::getPath("sd:/garbage.bin");
+	FILE* file = fopen(path.c_str(), "wb");
+	CHECK(file);
+	fputs("not a script cache, but long enough to hold its header", file);
+	fclose(file);
+	CHECK(!cache->startStreaming(&scriptInfo, "sd:/garbage.bin"));
+	remove(path.c_str());
+
+	// an upload still in progress, and then one that finished without any blocks
+	CHECK(cache->beginWrite(makeScriptInfo()).succeeded());
+	CHECK(!cache->startStreaming(&scriptInfo));
+	CHECK(cache->endWrite().succeeded());
+	CHECK(!cache->startStreaming(&scriptInfo));
+}
+
+} // namespace
+
+int main() {
+	char root[] = "/tmp/calypso_scriptcache_XXXXXX";
+	CHECK(mkdtemp(root));
+	nn::fs::host::gRoot = root;
+
+	test::resetFakes();
+	testInvalidFiles();
+
+	u64 seed = 1;
+	for (u32 blockFrames : { 1u, 17u, u32(ScriptCache::cChunkFrameNum) })
+		testChunkReader(seed++, blockFrames);
+
+	testReplay(seed++, Damage::None);
+	testReplay(seed++, Damage::TruncatedBlock);
+	testReplay(seed++, Damage::TruncatedFile);
+
+	remove(nn::fs::host::getPath(ScriptCache::cFilePath).c_str());
+	rmdir(root);
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "check.h"
+
+#include <cstring>
+
+#include <sead/random/seadGlobalRandom.h>
+
+#include "Library/LiveActor/LiveActor.h"
+#include "Library/Nerve/Nerve.h"
+
+#include "statehash.h"
+
+// checks the table-driven crc32c that builds without the armv8 crc32 instructions, which is what every host build gets
+
+using namespace cly;
+
+namespace {
+
+// one bit at a time, straight from the reversed castagnoli polynomial
+u32 crc32Reference(u32 crc, const u8* bytes, size_t size) {
+	crc = ~crc;
+	for (; size > 0; size--) {
+		crc ^= *bytes++;
+		for (s32 bit = 0; bit < 8; bit++)
+			crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+	}
+	return ~crc;
+}
+
+void testKnownVectors() {
+	// the standard check value
+	CHECK(statehash::crc32(0, "123456789", 9) == 0xE3069283);
+	CHECK(statehash::crc32(0, "", 0) == 0);
+
+	// the iSCSI test patterns from RFC 3720 B.4
+	u8 bytes[32];
+	memset(bytes, 0, sizeof(bytes));
+	CHECK(statehash::crc32(0, bytes, sizeof(bytes)) == 0x8A9136AA);
+	memset(bytes, 0xFF, sizeof(bytes));
+	CHECK(statehash::crc32(0, bytes, sizeof(bytes)) == 0x62A8AB43);
+	for (u32 i = 0; i < sizeof(bytes); i++)
+		bytes[i] = i;
+	CHECK(statehash::crc32(0, bytes, sizeof(bytes)) == 0x46DD794E);
+	for (u32 i = 0; i < sizeof(bytes); i++)
+		bytes[i] = 31 - i;
+	CHECK(statehash::crc32(0, bytes, sizeof(bytes)) == 0x113FDB5C);
+}
+
+void testAgainstReference() {
+	u8 bytes[300];
+	u32 seed = 1;
+	for (u8& byte : bytes) {
+		seed = seed * 1664525 + 1013904223;
+		byte = seed >> 24;
+	}
+
+	// every length, and every split of it into two calls, gives the same checksum as doing it all at once
+	for (size_t size = 0; size <= sizeof(bytes); size++) {
+		const u32 expected = crc32Reference(0, bytes, size);
+		CHECK(statehash::crc32(0, bytes, size) == expected);
+		for (size_t split = 0; split <= size; split += 7)
+			CHECK(statehash::crc32(statehash::crc32(0, bytes, split), bytes + split, size - split) == expected);
+	}
+}
+
+class WalkNerve : public al::Nerve {};
+
+class JumpNerve : public al::Nerve {};
+
+void testCompute() {
+	const WalkNerve walk;
+	const WalkNerve otherWalk;
+	const JumpNerve jump;
+	al::LiveActor player;
+	player.mNerve = &walk;
+
+	statehash::setStage("CapWorldHomeStage", 1);
+	const u32 hash = statehash::compute(&player);
+	CHECK(statehash::compute(&player) == hash);
+	// the nerve's type goes into the hash, not where it lives
+	player.mNerve = &otherWalk;
+	CHECK(statehash::compute(&player) == hash);
+
+	player.mNerve = &jump;
+	CHECK(statehash::compute(&player) != hash);
+	player.mNerve = &walk;
+	player.mTrans.x = 1.0f;
+	CHECK(statehash::compute(&player) != hash);
+	player.mTrans.x = 0.0f;
+	CHECK(statehash::compute(&player) == hash);
+
+	statehash::setStage("CapWorldHomeStage", 2);
+	CHECK(statehash::compute(&player) != hash);
+	statehash::setStage("CapWorldHomeStage", 1);
+
+	sead::GlobalRandom random;
+	sead::GlobalRandom::sInstance = &random;
+	const u32 withRandom = statehash::compute(&player);
+	CHECK(withRandom != hash);
+	random.mX++;
+	CHECK(statehash::compute(&player) != withRandom);
+	sead::GlobalRandom::sInstance = nullptr;
+
+	// with no player only the stage and rng are left
+	CHECK(statehash::compute(nullptr) == statehash::crc32(statehash::crc32(0, "CapWorldHomeStage", 17), "\1\0\0\0", 4));
+}
+
+} // namespace
+
+int main() {
+	testKnownVectors();
+	testAgainstReference();
+	testCompute();
+	return 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace al {
+
+class CameraTargetBase {
+public:
+	virtual ~CameraTargetBase() = default;
+};
+
+} // namespace al
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Library/Scene/Scene.h"
+
+namespace al {
+
+class CameraTargetBase;
+
+inline CameraTargetBase* getCameraTarget(const Scene* scene) {
+	return scene->mCameraTarget;
+}
+
+inline void setCameraTarget(const Scene* scene, CameraTargetBase* target) {
+	const_cast<Scene*>(scene)->mCameraTarget = target;
+}
+
+inline void requestCancelCameraInterpole(const Scene* scene, s32 sceneFrameNum) {
+	const_cast<Scene*>(scene)->mCameraInterpoleCancels++;
+}
+
+} // namespace al
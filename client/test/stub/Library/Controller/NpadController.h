@@ -0,0 +1,13 @@
+#pragma once
+
+#include <sead/controller/seadController.h>
+
+namespace al {
+
+class NpadController : public sead::Controller {
+public:
+	s32 mControllerMode = -1;
+	s32 mNpadId = -1;
+};
+
+} // namespace al
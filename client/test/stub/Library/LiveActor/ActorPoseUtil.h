@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Library/LiveActor/LiveActor.h"
+
+namespace al {
+
+inline const sead::Vector3f& getTrans(const LiveActor* actor) {
+	return actor->mTrans;
+}
+
+inline const sead::Quatf& getQuat(const LiveActor* actor) {
+	return actor->mQuat;
+}
+
+inline const sead::Vector3f& getVelocity(const LiveActor* actor) {
+	return actor->mVelocity;
+}
+
+inline const sead::Vector3f& getGravity(const LiveActor* actor) {
+	return actor->mGravity;
+}
+
+inline void setTrans(LiveActor* actor, const sead::Vector3f& trans) {
+	actor->mTrans = trans;
+}
+
+inline void setQuat(LiveActor* actor, const sead::Quatf& quat) {
+	actor->mQuat = quat;
+}
+
+inline void setVelocity(LiveActor* actor, const sead::Vector3f& velocity) {
+	actor->mVelocity = velocity;
+}
+
+inline void setGravity(LiveActor* actor, const sead::Vector3f& gravity) {
+	actor->mGravity = gravity;
+}
+
+} // namespace al
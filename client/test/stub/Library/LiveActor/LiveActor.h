@@ -0,0 +1,20 @@
+#pragma once
+
+#include <sead/math/seadQuat.h>
+#include <sead/math/seadVector.h>
+
+namespace al {
+
+class Nerve;
+
+// only the pose and the current nerve, held directly rather than behind an ActorPoseKeeper and NerveKeeper
+class LiveActor {
+public:
+	sead::Vector3f mTrans = {};
+	sead::Quatf mQuat = {};
+	sead::Vector3f mVelocity = {};
+	sead::Vector3f mGravity = {};
+	const Nerve* mNerve = nullptr;
+};
+
+} // namespace al
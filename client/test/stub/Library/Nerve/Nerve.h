@@ -0,0 +1,11 @@
+#pragma once
+
+namespace al {
+
+// nerves are polymorphic, so typeid sees the concrete nerve's name
+class Nerve {
+public:
+	virtual ~Nerve() = default;
+};
+
+} // namespace al
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Library/LiveActor/LiveActor.h"
+#include "Library/Nerve/Nerve.h"
+
+namespace al {
+
+inline const Nerve* getCurrentNerve(const LiveActor* actor) {
+	return actor->mNerve;
+}
+
+inline void setNerve(LiveActor* actor, const Nerve* nerve) {
+	actor->mNerve = nerve;
+}
+
+} // namespace al
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include "Library/LiveActor/LiveActor.h"
+
+namespace al {
+
+class CameraTargetBase;
+
+// a scene with at most one player in it, and a camera that is only a target
+class Scene {
+public:
+	LiveActor* mPlayer = nullptr;
+	CameraTargetBase* mCameraTarget = nullptr;
+	// how many times the camera was told to cut rather than pan
+	s32 mCameraInterpoleCancels = 0;
+};
+
+} // namespace al
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <atomic>
+#include <thread>
+
+#include <sead/heap/seadHeap.h>
+#include <sead/prim/seadSafeString.h>
+
+namespace sead {
+
+struct CoreId {
+	s32 value = 0;
+};
+
+} // namespace sead
+
+namespace al {
+
+class FunctorBase {
+public:
+	virtual ~FunctorBase() = default;
+	virtual void operator()() const = 0;
+	virtual FunctorBase* clone() const = 0;
+};
+
+// calls a member function with no arguments on `object`
+template <typename T, typename F>
+class FunctorV0M : public FunctorBase {
+	T mObject;
+	F mFunction;
+
+public:
+	FunctorV0M(T object, F function) : mObject(object), mFunction(function) {}
+
+	void operator()() const override { (mObject->*mFunction)(); }
+
+	FunctorBase* clone() const override { return new FunctorV0M(*this); }
+};
+
+// runs the functor on a std::thread each time it's started. like the game's, it can be started again once it's done
+class AsyncFunctorThread {
+	FunctorBase* mFunctor;
+	std::thread mThread;
+	std::atomic_bool mIsDone = true;
+
+public:
+	AsyncFunctorThread(const sead::SafeString&, const FunctorBase& functor, s32, s32, sead::CoreId) : mFunctor(functor.clone()) {}
+
+	~AsyncFunctorThread() {
+		if (mThread.joinable()) mThread.join();
+		delete mFunctor;
+	}
+
+	void start() {
+		if (mThread.joinable()) mThread.join();
+		mIsDone = false;
+		mThread = std::thread([this] {
+			(*mFunctor)();
+			mIsDone = true;
+		});
+	}
+
+	bool isDone() const { return mIsDone; }
+};
+
+} // namespace al
@@ -0,0 +1,8 @@
+#pragma once
+
+class ChangeStageInfo {
+public:
+	enum SubScenarioType : int {
+		NO_SUB_SCENARIO = 0,
+	};
+};
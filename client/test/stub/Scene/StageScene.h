@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Library/Scene/Scene.h"
+
+namespace rs {
+
+inline al::LiveActor* getPlayerActor(const al::Scene* scene) {
+	return scene->mPlayer;
+}
+
+} // namespace rs
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace hk {
+
+class Result {
+	u32 mValue = 0;
+
+public:
+	constexpr Result() = default;
+	constexpr Result(u32 value) : mValue(value) {}
+
+	constexpr bool succeeded() const { return mValue == 0; }
+
+	constexpr bool failed() const { return mValue != 0; }
+
+	constexpr u32 getValue() const { return mValue; }
+};
+
+constexpr Result ResultSuccess() {
+	return Result();
+}
+
+// hakkun's generic failure. any nonzero value will do here
+constexpr Result ResultFailed() {
+	return Result(1);
+}
+
+} // namespace hk
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <cstring>
+
+namespace hk {
+
+template <size_t Capacity>
+class FixedString {
+	char mData[Capacity] = {};
+
+public:
+	const char* cstr() const { return mData; }
+
+	void set(const char* str) {
+		strncpy(mData, str, Capacity - 1);
+		mData[Capacity - 1] = '\0';
+	}
+};
+
+} // namespace hk
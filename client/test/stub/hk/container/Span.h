@@ -0,0 +1,26 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace hk {
+
+template <typename T>
+class Span {
+	T* mData = nullptr;
+	size_t mSize = 0;
+
+public:
+	constexpr Span() = default;
+	constexpr Span(T* data, size_t size) : mData(data), mSize(size) {}
+
+	constexpr T* data() const { return mData; }
+
+	constexpr size_t size() const { return mSize; }
+
+	constexpr T& operator[](size_t index) const { return mData[index]; }
+};
+
+template <typename T>
+Span(T*, size_t) -> Span<T>;
+
+} // namespace hk
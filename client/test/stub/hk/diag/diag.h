@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cassert>
+
+#define HK_ASSERT(CONDITION) assert(CONDITION)
+#define HK_ABORT_UNLESS(CONDITION, ...) assert(CONDITION)
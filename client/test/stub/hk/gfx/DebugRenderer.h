@@ -0,0 +1,7 @@
+#pragma once
+
+namespace hk::gfx {
+
+class DebugRenderer;
+
+} // namespace hk::gfx
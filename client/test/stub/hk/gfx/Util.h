@@ -0,0 +1,11 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace hk::gfx {
+
+constexpr u32 rgbaf(f32 r, f32 g, f32 b, f32 a) {
+	return u32(r * 255) | u32(g * 255) << 8 | u32(b * 255) << 16 | u32(a * 255) << 24;
+}
+
+} // namespace hk::gfx
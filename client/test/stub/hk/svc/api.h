@@ -0,0 +1,14 @@
+#pragma once
+
+#include <hk/types.h>
+
+#include <chrono>
+#include <thread>
+
+namespace hk::svc {
+
+inline void SleepThread(s64 ns) {
+	std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+}
+
+} // namespace hk::svc
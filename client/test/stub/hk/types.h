@@ -0,0 +1,27 @@
+#pragma once
+
+// host stand-in for hakkun's hk/types.h: just the integer typedefs and cast helper the client's sources use
+
+#include <cstddef>
+#include <cstdint>
+
+using u8 = uint8_t;
+using u16 = uint16_t;
+using u32 = uint32_t;
+using u64 = uint64_t;
+using s8 = int8_t;
+using s16 = int16_t;
+using s32 = int32_t;
+using s64 = int64_t;
+using f32 = float;
+using f64 = double;
+using uintptr = uintptr_t;
+using ptr = uintptr_t;
+
+template <typename To, typename From>
+constexpr To cast(From value) {
+	return (To)(value);
+}
+
+// hakkun's own types.h brings Result along with it
+#include <hk/Result.h>
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace hk::util {
+
+template <typename T>
+struct Vector2 {
+	T x;
+	T y;
+};
+
+using Vector2i = Vector2<s32>;
+using Vector2f = Vector2<f32>;
+
+} // namespace hk::util
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <nn/types.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a stand-in for the sd card on top of the host's filesystem. a path's mount name is dropped and the rest is looked up under
+// nn::fs::host::gRoot, so "sd:/calypso_script.bin" is "<root>/calypso_script.bin".
+// the behaviour the client relies on is kept: reads past the end fail, and a file only grows when opened with OpenMode_Append
+
+namespace nn::fs {
+
+struct FileHandle {
+	s32 fd;
+	s32 mode;
+};
+
+enum OpenMode {
+	OpenMode_Read = 1 << 0,
+	OpenMode_Write = 1 << 1,
+	OpenMode_Append = 1 << 2,
+};
+
+enum DirectoryEntryType {
+	DirectoryEntryType_Directory,
+	DirectoryEntryType_File,
+};
+
+enum WriteOptionFlag {
+	WriteOptionFlag_Flush = 1 << 0,
+};
+
+struct WriteOption {
+	s32 flags;
+
+	static WriteOption CreateOption(s32 flags) { return { flags }; }
+};
+
+namespace host {
+
+inline std::string gRoot = ".";
+
+// fs results are module 2. which description doesn't matter to the client, as long as it's a failure
+constexpr Result cResultNotFound = 2 | 1 << 9;
+constexpr Result cResultAlreadyExists = 2 | 2 << 9;
+constexpr Result cResultOutOfRange = 2 | 3 << 9;
+constexpr Result cResultIoError = 2 | 4 << 9;
+
+inline std::string getPath(const char* path) {
+	const char* mount = strstr(path, ":/");
+	return gRoot + "/" + (mount ? mount + 2 : path);
+}
+
+} // namespace host
+
+inline Result CreateFile(const char* path, s64 size) {
+	const s32 fd = open(host::getPath(path).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) return errno == EEXIST ? host::cResultAlreadyExists : host::cResultNotFound;
+
+	const bool isOk = ftruncate(fd, size) == 0;
+	close(fd);
+	return isOk ? Result() : host::cResultIoError;
+}
+
+inline Result DeleteFile(const char* path) {
+	return unlink(host::getPath(path).c_str()) == 0 ? Result() : host::cResultNotFound;
+}
+
+// `type` is left alone if there's nothing at `path`
+inline Result GetEntryType(DirectoryEntryType* type, const char* path) {
+	struct stat info;
+	if (stat(host::getPath(path).c_str(), &info) != 0) return host::cResultNotFound;
+
+	*type = S_ISDIR(info.st_mode) ? DirectoryEntryType_Directory : DirectoryEntryType_File;
+	return Result();
+}
+
+inline Result OpenFile(FileHandle* handle, const char* path, s32 mode) {
+	const s32 flags = mode & OpenMode_Write ? O_RDWR : O_RDONLY;
+	const s32 fd = open(host::getPath(path).c_str(), flags);
+	if (fd < 0) return host::cResultNotFound;
+
+	*handle = { fd, mode };
+	return Result();
+}
+
+inline void CloseFile(FileHandle handle) {
+	close(handle.fd);
+}
+
+inline Result GetFileSize(s64* size, FileHandle handle) {
+	struct stat info;
+	if (fstat(handle.fd, &info) != 0) return host::cResultIoError;
+
+	*size = info.st_size;
+	return Result();
+}
+
+inline Result ReadFile(FileHandle handle, s64 offset, void* buffer, u64 size) {
+	s64 fileSize;
+	if (GetFileSize(&fileSize, handle).IsFailure()) return host::cResultIoError;
+	if (offset < 0 || u64(offset) + size > u64(fileSize)) return host::cResultOutOfRange;
+
+	return pread(handle.fd, buffer, size, offset) == s64(size) ? Result() : host::cResultIoError;
+}
+
+inline Result WriteFile(FileHandle handle, s64 offset, const void* buffer, u64 size, const WriteOption& option) {
+	if (!(handle.mode & OpenMode_Write)) return host::cResultIoError;
+
+	s64 fileSize;
+	if (GetFileSize(&fileSize, handle).IsFailure()) return host::cResultIoError;
+	if (offset < 0 || (!(handle.mode & OpenMode_Append) && u64(offset) + size > u64(fileSize))) return host::cResultOutOfRange;
+
+	if (pwrite(handle.fd, buffer, size, offset) != s64(size)) return host::cResultIoError;
+	if (option.flags & WriteOptionFlag_Flush) fsync(handle.fd);
+	return Result();
+}
+
+} // namespace nn::fs
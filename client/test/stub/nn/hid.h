@@ -0,0 +1,24 @@
+#pragma once
+
+#include <nn/types.h>
+
+namespace nn::hid {
+
+enum NpadStyleTag : u32 {
+	NpadStyleInvalid = 0,
+};
+
+struct AnalogStickState {
+	s32 x;
+	s32 y;
+};
+
+struct NpadJoyDualState {
+	s64 samplingNumber;
+	u64 buttons;
+	AnalogStickState analogStickL;
+	AnalogStickState analogStickR;
+	u32 attributes;
+};
+
+} // namespace nn::hid
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <hk/types.h>
+
+namespace nn {
+
+// module and description packed the way the sdk does it, so results can be logged the same way
+class Result {
+	u32 mValue = 0;
+
+public:
+	constexpr Result() = default;
+	constexpr Result(u32 value) : mValue(value) {}
+
+	constexpr bool IsSuccess() const { return mValue == 0; }
+
+	constexpr bool IsFailure() const { return mValue != 0; }
+
+	constexpr u32 GetModule() const { return mValue & 0x1FF; }
+
+	constexpr u32 GetDescription() const { return mValue >> 9 & 0x1FFF; }
+
+	constexpr u32 GetInnerValueForDebug() const { return mValue; }
+};
+
+} // namespace nn
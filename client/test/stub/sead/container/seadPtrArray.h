@@ -0,0 +1,19 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+namespace sead {
+
+template <typename T>
+class PtrArray {
+	s32 mPtrNum = 0;
+	s32 mPtrNumMax = 0;
+	T** mPtrs = nullptr;
+};
+
+template <typename T, s32 N>
+class FixedPtrArray : public PtrArray<T> {
+	T* mWork[N] = {};
+};
+
+} // namespace sead
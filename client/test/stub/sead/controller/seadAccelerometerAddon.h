@@ -0,0 +1,13 @@
+#pragma once
+
+#include <sead/controller/seadControllerAddon.h>
+#include <sead/math/seadVector.h>
+
+namespace sead {
+
+class AccelerometerAddon : public ControllerAddon {
+public:
+	Vector3f mAcceleration = Vector3f::zero;
+};
+
+} // namespace sead
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <sead/controller/seadControllerAddon.h>
+#include <sead/math/seadVector.h>
+#include <sead/prim/seadBitFlag.h>
+
+namespace sead {
+
+struct ControllerDefine {
+	enum AddonId {
+		cAddon_Null,
+		cAddon_Accelerometer,
+	};
+};
+
+// only the state tas::System reads and writes. addons are handed in by whoever owns the controller
+class Controller {
+public:
+	enum PadIdx {
+		cPadIdx_A = 0,
+		cPadIdx_B = 1,
+		cPadIdx_C = 2,
+		cPadIdx_X = 3,
+		cPadIdx_Y = 4,
+		cPadIdx_Z = 5,
+		cPadIdx_2 = 6,
+		cPadIdx_1 = 7,
+		cPadIdx_Home = 8,
+		cPadIdx_Minus = 9,
+		cPadIdx_Plus = 10,
+		cPadIdx_Start = 11,
+		cPadIdx_Select = 12,
+		cPadIdx_ZL = cPadIdx_C,
+		cPadIdx_ZR = cPadIdx_Z,
+		cPadIdx_L = 13,
+		cPadIdx_R = 14,
+		cPadIdx_Touch = 15,
+		cPadIdx_Up = 16,
+		cPadIdx_Down = 17,
+		cPadIdx_Left = 18,
+		cPadIdx_Right = 19,
+	};
+
+	constexpr static s32 cAddonNumMax = 2;
+
+	BitFlag32 mPadHold = 0;
+	Vector2f mLeftStick = Vector2f::zero;
+	Vector2f mRightStick = Vector2f::zero;
+	ControllerAddon* mAccelerometers[cAddonNumMax] = {};
+
+	virtual ~Controller() = default;
+
+	ControllerAddon* getAddonByOrder(ControllerDefine::AddonId id, s32 order) const {
+		if (id != ControllerDefine::cAddon_Accelerometer || order >= cAddonNumMax) return nullptr;
+		return mAccelerometers[order];
+	}
+};
+
+} // namespace sead
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+namespace sead {
+
+class ControllerAddon {
+public:
+	virtual ~ControllerAddon() = default;
+};
+
+} // namespace sead
@@ -0,0 +1,29 @@
+#pragma once
+
+namespace sead {
+
+class Heap;
+
+} // namespace sead
+
+// singletons are plain heap objects here. deleteInstance lets a test start over from a fresh one
+#define SEAD_SINGLETON_DISPOSER(CLASS)                                                                                                                         \
+public:                                                                                                                                                        \
+	static CLASS* instance() { return sInstance; }                                                                                                             \
+	static CLASS* createInstance(sead::Heap* heap);                                                                                                            \
+	static void deleteInstance();                                                                                                                              \
+                                                                                                                                                               \
+private:                                                                                                                                                       \
+	static CLASS* sInstance
+
+#define SEAD_SINGLETON_DISPOSER_IMPL(CLASS)                                                                                                                    \
+	CLASS* CLASS::sInstance = nullptr;                                                                                                                         \
+	CLASS* CLASS::createInstance(sead::Heap*) {                                                                                                                \
+		if (!sInstance) sInstance = new CLASS();                                                                                                               \
+		return sInstance;                                                                                                                                      \
+	}                                                                                                                                                          \
+	void CLASS::deleteInstance() {                                                                                                                             \
+		delete sInstance;                                                                                                                                      \
+		sInstance = nullptr;                                                                                                                                   \
+	}                                                                                                                                                          \
+	static_assert(true)
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <sead/heap/seadDisposer.h>
+#include <sead/prim/seadSafeString.h>
+
+#include <new>
+
+namespace sead {
+
+class Heap;
+
+} // namespace sead
+
+// `new (heap)` allocates from that heap on the console. here everything comes from the global heap
+inline void* operator new(size_t size, sead::Heap*) {
+	return ::operator new(size);
+}
+
+inline void operator delete(void* block, sead::Heap*) {
+	::operator delete(block);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <sead/heap/seadHeap.h>
+
+namespace sead {
+
+// there's only the one global heap on the host, so there's nothing to switch
+class ScopedCurrentHeapSetter {
+public:
+	explicit ScopedCurrentHeapSetter(Heap*) {}
+};
+
+} // namespace sead
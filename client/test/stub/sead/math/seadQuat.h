@@ -0,0 +1,17 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+namespace sead {
+
+template <typename T>
+struct Quat {
+	T x;
+	T y;
+	T z;
+	T w;
+};
+
+using Quatf = Quat<f32>;
+
+} // namespace sead
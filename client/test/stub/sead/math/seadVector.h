@@ -0,0 +1,38 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+namespace sead {
+
+template <typename T>
+struct Vector2 {
+	T x;
+	T y;
+
+	static const Vector2 zero;
+
+	void set(const Vector2& other) { *this = other; }
+};
+
+template <typename T>
+const Vector2<T> Vector2<T>::zero = { 0, 0 };
+
+template <typename T>
+struct Vector3 {
+	T x;
+	T y;
+	T z;
+
+	static const Vector3 zero;
+
+	void set(const Vector3& other) { *this = other; }
+};
+
+template <typename T>
+const Vector3<T> Vector3<T>::zero = { 0, 0, 0 };
+
+using Vector2i = Vector2<s32>;
+using Vector2f = Vector2<f32>;
+using Vector3f = Vector3<f32>;
+
+} // namespace sead
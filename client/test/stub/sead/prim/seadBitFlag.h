@@ -0,0 +1,27 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+namespace sead {
+
+template <typename T>
+class BitFlag {
+	T mBits = 0;
+
+public:
+	constexpr BitFlag() = default;
+	constexpr BitFlag(T bits) : mBits(bits) {}
+
+	constexpr T getDirect() const { return mBits; }
+
+	constexpr bool isOnBit(s32 bit) const { return mBits & (T(1) << bit); }
+
+	constexpr void setBit(s32 bit) { mBits |= T(1) << bit; }
+
+	constexpr void makeAllZero() { mBits = 0; }
+};
+
+using BitFlag32 = BitFlag<u32>;
+using BitFlag64 = BitFlag<u64>;
+
+} // namespace sead
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <typeinfo>
+
+namespace sead {
+
+class SafeString {
+protected:
+	const char* mStringTop;
+
+public:
+	static const SafeString cEmptyString;
+
+	SafeString(const char* str = "") : mStringTop(str) {}
+
+	const char* cstr() const { return mStringTop; }
+};
+
+inline const SafeString SafeString::cEmptyString;
+
+class BufferedSafeString : public SafeString {
+	s32 mBufferSize;
+
+protected:
+	char* getBuffer() { return const_cast<char*>(mStringTop); }
+
+public:
+	BufferedSafeString(char* buffer, s32 size) : SafeString(buffer), mBufferSize(size) {
+		buffer[0] = '\0';
+	}
+
+	void copy(const SafeString& other) {
+		strncpy(getBuffer(), other.cstr(), mBufferSize - 1);
+		getBuffer()[mBufferSize - 1] = '\0';
+	}
+
+	[[gnu::format(printf, 2, 3)]] s32 format(const char* fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		const s32 len = vsnprintf(getBuffer(), mBufferSize, fmt, args);
+		va_end(args);
+		return len;
+	}
+};
+
+template <s32 N>
+class FixedSafeString : public BufferedSafeString {
+	char mBuffer[N];
+
+public:
+	FixedSafeString() : BufferedSafeString(mBuffer, N) {}
+
+	FixedSafeString(const SafeString& other) : BufferedSafeString(mBuffer, N) {
+		copy(other);
+	}
+
+	FixedSafeString(const FixedSafeString& other) : BufferedSafeString(mBuffer, N) {
+		copy(other);
+	}
+
+	FixedSafeString& operator=(const SafeString& other) {
+		copy(other);
+		return *this;
+	}
+
+	FixedSafeString& operator=(const FixedSafeString& other) {
+		copy(other);
+		return *this;
+	}
+};
+
+} // namespace sead
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sead/basis/seadTypes.h>
+
+namespace sead {
+
+class Random {
+public:
+	u32 mX = 0;
+	u32 mY = 0;
+	u32 mZ = 0;
+	u32 mW = 0;
+};
+
+// a singleton in the real sead. here a test installs one by pointing sInstance at it
+class GlobalRandom : public Random {
+public:
+	static inline GlobalRandom* sInstance = nullptr;
+
+	static GlobalRandom* instance() { return sInstance; }
+};
+
+} // namespace sead
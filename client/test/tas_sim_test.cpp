@@ -0,0 +1,378 @@
+#include "check.h"
+#include "fakes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <sead/controller/seadAccelerometerAddon.h>
+
+#include "Library/Controller/NpadController.h"
+
+#include "server.h"
+#include "tas.h"
+
+// replays scripts through tas::System the way the game drives it, one game frame at a time,
+// with a stand-in for the recv thread that feeds the frame buffer with uneven timing.
+// everything runs on one thread with seeded randomness, so a failing seed fails the same way every time
+
+using namespace cly;
+using tas::Pauser;
+using tas::System;
+
+namespace {
+
+struct Rng {
+	u64 state;
+
+	u32 next() {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		return u32(state >> 32);
+	}
+
+	u32 below(u32 n) { return next() % n; }
+};
+
+struct Options {
+	u64 seed = 1;
+	u32 spanNum = 500;
+	bool isTwoPlayer = false;
+	// game frame the script's first span starts on
+	u32 firstFrame = 0;
+	// percent chance per game frame of the network going quiet for up to stallFramesMax frames
+	u32 stallChance = 1;
+	u32 stallFramesMax = 300;
+	// percent chance per game frame of the player pausing or unpausing
+	u32 pauseChance = 0;
+	// game frame on which the server stops the replay and starts it over, 0 for never
+	u32 restartFrame = 0;
+};
+
+Server::Controller makeController(Rng& rng) {
+	Server::Controller controller = {};
+	controller.buttons = rng.next() & 0xFFFF;
+	controller.leftStick = { s32(rng.below(65535)) - 32767, s32(rng.below(65535)) - 32767 };
+	controller.rightStick = { s32(rng.below(65535)) - 32767, s32(rng.below(65535)) - 32767 };
+	controller.accelLeft = { f32(rng.below(100)), f32(rng.below(100)), 1.0f };
+	controller.accelRight = { 1.0f, f32(rng.below(100)), f32(rng.below(100)) };
+	return controller;
+}
+
+// spans as the server sends them: serverIndex counts up from 0, and frameIndex jumps over frames that repeat the last inputs
+std::vector<Server::FramePacket> makeScript(Rng& rng, const Options& options) {
+	std::vector<Server::FramePacket> spans(options.spanNum);
+	u32 frame = options.firstFrame;
+	for (u32 i = 0; i < options.spanNum; i++) {
+		Server::FramePacket& span = spans[i];
+		memset(&span, 0, sizeof(span));
+		span.serverIndex = i;
+		span.frameIndex = frame;
+		span.player1 = makeController(rng);
+		if (options.isTwoPlayer) span.player2 = makeController(rng);
+
+		const u32 roll = rng.below(20);
+		frame += roll < 16 ? 1 : roll < 19 ? 2 + rng.below(8) : 10 + rng.below(90);
+		span.nextFrameIndex = i + 1 < options.spanNum ? frame : System::cNoNextFrame;
+	}
+	return spans;
+}
+
+// the inputs the game should see on game frame `frame`
+Server::FramePacket expectedFrame(const std::vector<Server::FramePacket>& spans, u32 frame) {
+	Server::FramePacket none;
+	memset(&none, 0, sizeof(none));
+	if (frame < spans.front().frameIndex) return none;
+
+	for (const Server::FramePacket& span : spans) {
+		if (span.nextFrameIndex == System::cNoNextFrame ? frame == span.frameIndex : frame < span.nextFrameIndex) return span;
+	}
+	CHECK(!"frame past the end of the script");
+	return none;
+}
+
+// stands in for the recv thread and the server behind it: sends spans in bursts, out of order and sometimes twice,
+// backs off when the window is full and goes quiet every so often
+class Link {
+	const std::vector<Server::FramePacket>& mSpans;
+	std::vector<bool> mIsDelivered;
+	u32 mNext = 0;
+	u32 mStallFrames = 0;
+
+public:
+	explicit Link(const std::vector<Server::FramePacket>& spans) : mSpans(spans), mIsDelivered(spans.size(), false) {}
+
+	// the server starts sending from the first span again, after a back-off or a new replay
+	void rewind() {
+		mNext = 0;
+		std::fill(mIsDelivered.begin(), mIsDelivered.end(), false);
+	}
+
+	void step(Rng& rng, const Options& options) {
+		// Server::isWaitingOnReplayStart: nothing is stored until the game thread has started the replay
+		if (System::isStartPending()) {
+			rewind();
+			return;
+		}
+		if (mStallFrames > 0) {
+			mStallFrames--;
+			return;
+		}
+		if (rng.below(100) < options.stallChance) {
+			mStallFrames = 1 + rng.below(options.stallFramesMax);
+			return;
+		}
+		// packets arrive on some frames and not others, a little faster than the script plays on average
+		if (rng.below(3) != 0) return;
+
+		// a burst covers a few spans past the oldest one still missing, shuffled
+		std::vector<u32> keys;
+		const u32 burst = 1 + rng.below(4);
+		for (u32 key = mNext; key < mSpans.size() && keys.size() < burst; key++) {
+			if (!mIsDelivered[key] || rng.below(8) == 0) keys.push_back(key);
+		}
+		for (u32 i = keys.size(); i > 1; i--)
+			std::swap(keys[i - 1], keys[rng.below(i)]);
+
+		Server::FrameBuffer& buffer = Server::instance()->mFrameBuffer;
+		for (u32 key : keys) {
+			bool isFull;
+			Server::FramePacket* slot = buffer.beginWrite(key, &isFull);
+			if (isFull) continue;
+			// otherwise it's either wanted, or already buffered or played, which is as good as delivered
+			if (slot) {
+				*slot = mSpans[key];
+				buffer.endWrite(key);
+			}
+			mIsDelivered[key] = true;
+		}
+		while (mNext < mSpans.size() && mIsDelivered[mNext])
+			mNext++;
+	}
+};
+
+// what one controller was given for the frame
+struct Injected {
+	u32 padHold;
+	sead::Vector2f leftStick;
+	sead::Vector2f rightStick;
+	sead::Vector3f accel[System::cAccelNum];
+};
+
+struct Pad {
+	al::NpadController controller;
+	sead::AccelerometerAddon accel[System::cAccelNum];
+
+	explicit Pad(s32 player) {
+		controller.mControllerMode = player;
+		controller.mNpadId = player;
+		for (s32 i = 0; i < System::cAccelNum; i++)
+			controller.mAccelerometers[i] = &accel[i];
+	}
+
+	// a pattern no script frame produces, since converted STAS buttons never set the high bits
+	void holdRealInput() {
+		controller.mPadHold = 0xF0000000;
+		controller.mLeftStick.set({ 0.5f, 0.5f });
+		controller.mRightStick.set({ -0.5f, -0.5f });
+		for (sead::AccelerometerAddon& addon : accel)
+			addon.mAcceleration.set({ 2.0f, 2.0f, 2.0f });
+	}
+
+	bool isHoldingRealInput() const {
+		const Injected injected = read();
+		return injected.padHold == 0xF0000000 && injected.leftStick.x == 0.5f && injected.rightStick.y == -0.5f && injected.accel[0].x == 2.0f &&
+			injected.accel[1].z == 2.0f;
+	}
+
+	Injected read() const {
+		return { controller.mPadHold.getDirect(), controller.mLeftStick, controller.mRightStick, { accel[0].mAcceleration, accel[1].mAcceleration } };
+	}
+};
+
+void checkInjected(const Injected& injected, const Server::Controller& expected, bool isDualJoycons) {
+	CHECK(injected.padHold == tas::convertButtonsSTASToSead(expected.buttons).getDirect());
+	CHECK(injected.leftStick.x == f32(expected.leftStick.x) / 32767.f);
+	CHECK(injected.leftStick.y == f32(expected.leftStick.y) / 32767.f);
+	CHECK(injected.rightStick.x == f32(expected.rightStick.x) / 32767.f);
+	CHECK(injected.rightStick.y == f32(expected.rightStick.y) / 32767.f);
+	CHECK(memcmp(&injected.accel[0], &expected.accelLeft, sizeof(sead::Vector3f)) == 0);
+	if (isDualJoycons) CHECK(memcmp(&injected.accel[1], &expected.accelRight, sizeof(sead::Vector3f)) == 0);
+}
+
+void simulate(const Options& options) {
+	test::resetFakes();
+	Rng rng = { options.seed };
+	const std::vector<Server::FramePacket> spans = makeScript(rng, options);
+	const u32 gameFrameNum = spans.back().frameIndex + 1;
+
+	Link link(spans);
+	Pad pads[System::cPlayerNum] = { Pad(0), Pad(1) };
+	Pauser* pauser = Pauser::instance();
+
+	Server::ScriptInfoPacket scriptInfo = {};
+	scriptInfo.frameCount = spans.size();
+	scriptInfo.playerCount = options.isTwoPlayer ? 2 : 1;
+	scriptInfo.controllerTypes[0] = System::cControllerType_DualJoycons;
+	scriptInfo.controllerTypes[1] = options.isTwoPlayer ? System::cControllerType_DualJoycons : System::cControllerType_None;
+	System::setScriptInfo(scriptInfo);
+	// the recv thread's StartScript, which the first checkForNextFrame picks up
+	u32 replayId = 7;
+	System::requestStartReplay(replayId);
+	CHECK(!System::isReplaying());
+
+	u32 appliedFrames = 0;
+	u32 blockedFrames = 0;
+	u32 underruns = 0;
+	u32 pausedFrames = 0;
+	u32 frame = 0;
+	const u32 frameLimit = gameFrameNum * 20 + 1000;
+	// time spent in tas::System and Pauser, leaving out the simulator's own bookkeeping
+	std::chrono::steady_clock::duration overhead = {};
+	const auto timed = [&overhead](auto&& func) {
+		const auto start = std::chrono::steady_clock::now();
+		func();
+		overhead += std::chrono::steady_clock::now() - start;
+	};
+
+	for (; System::isReplaying() || System::isStartPending(); frame++) {
+		CHECK(frame < frameLimit + options.restartFrame);
+
+		// StopScript and StartScript back to back. the old replay keeps going until the game thread gets to them
+		if (options.restartFrame != 0 && frame == options.restartFrame) {
+			System::requestStopReplay();
+			System::requestStartReplay(++replayId);
+			CHECK(System::isReplaying());
+			link.rewind();
+		}
+
+		if (rng.below(100) < options.pauseChance) pauser->togglePause();
+
+		// whatever the players are actually pressing, which the script overrides
+		for (Pad& pad : pads)
+			pad.holdRealInput();
+
+		// al::NpadController::calcImpl_
+		timed([&pads] {
+			for (Pad& pad : pads)
+				System::processInputs(&pad.controller);
+		});
+
+		// GameSystem::movement. the scene only runs while the sequence does, and it advances the script as it does
+		if (pauser->isSequenceActive()) {
+			const u32 frameIdx = System::getFrameIndex();
+			timed(System::getNextFrame);
+			if (System::getFrameIndex() != frameIdx) {
+				CHECK(System::getFrameIndex() == frameIdx + 1);
+				const Server::FramePacket expected = expectedFrame(spans, frameIdx);
+				checkInjected(pads[0].read(), expected.player1, true);
+				if (options.isTwoPlayer)
+					checkInjected(pads[1].read(), expected.player2, true);
+				else
+					CHECK(pads[1].isHoldingRealInput());
+				appliedFrames++;
+			}
+		} else if (pauser->isManuallyPaused()) {
+			pausedFrames++;
+		}
+
+		bool wasBlocked = pauser->isBlocked();
+		const u32 lastReplayId = System::getReplayId();
+		timed(System::checkForNextFrame);
+		if (System::getReplayId() != lastReplayId) {
+			// only the last replay is counted, from its first frame
+			CHECK(System::isReplaying() && System::getReplayId() == replayId && System::getFrameIndex() == 0);
+			CHECK(!System::isStartPending());
+			appliedFrames = blockedFrames = underruns = 0;
+			wasBlocked = false;
+		}
+		if (System::isReplaying() && pauser->isBlocked()) {
+			blockedFrames++;
+			if (!wasBlocked) underruns++;
+		}
+
+		// GameSystem::drawMain
+		timed([pauser] { pauser->update(); });
+
+		link.step(rng, options);
+	}
+
+	const System::Stats& stats = System::getStats();
+	CHECK(appliedFrames == gameFrameNum);
+	CHECK(stats.appliedFrames == gameFrameNum);
+	CHECK(stats.blockedFrames == blockedFrames);
+	CHECK(stats.underruns == underruns);
+	CHECK(System::getFramesReleased() == spans.size());
+	CHECK(test::gFakes.scriptsCompleted == 1);
+	CHECK(!pauser->isBlocked());
+	CHECK(System::getReplayId() == replayId);
+
+	const f64 overheadNs = std::chrono::duration<f64, std::nano>(overhead).count() / frame;
+	printf("seed %lu: %u spans, %u game frames, %u blocked in %u underruns, %u paused, %.0fns per frame\n", options.seed, u32(spans.size()),
+		gameFrameNum, stats.blockedFrames, stats.underruns, pausedFrames, overheadNs);
+}
+
+// key=value pairs naming Options fields, e.g. `tas_sim_test seed=5 spanNum=10000 stallChance=10` to try out a particular server pacing
+bool parseOptions(s32 argc, char** argv, Options* options) {
+	for (s32 i = 1; i < argc; i++) {
+		const char* value = strchr(argv[i], '=');
+		if (!value) return false;
+
+		const std::string_view key(argv[i], value - argv[i]);
+		const u64 number = strtoull(value + 1, nullptr, 0);
+		if (key == "seed")
+			options->seed = number;
+		else if (key == "spanNum")
+			options->spanNum = number;
+		else if (key == "isTwoPlayer")
+			options->isTwoPlayer = number != 0;
+		else if (key == "firstFrame")
+			options->firstFrame = number;
+		else if (key == "stallChance")
+			options->stallChance = number;
+		else if (key == "stallFramesMax")
+			options->stallFramesMax = number;
+		else if (key == "pauseChance")
+			options->pauseChance = number;
+		else if (key == "restartFrame")
+			options->restartFrame = number;
+		else
+			return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int main(s32 argc, char** argv) {
+	if (argc > 1) {
+		Options options;
+		if (!parseOptions(argc, argv, &options)) {
+			fprintf(
+				stderr, "usage: %s [seed=N] [spanNum=N] [isTwoPlayer=0|1] [firstFrame=N] [stallChance=N] [stallFramesMax=N] [pauseChance=N] [restartFrame=N]\n",
+				argv[0]
+			);
+			return 1;
+		}
+		simulate(options);
+		return 0;
+	}
+
+	for (u64 seed = 1; seed <= 8; seed++)
+		simulate({ .seed = seed, .isTwoPlayer = seed % 2 == 0 });
+
+	// a script that starts partway in plays nothing until its first span comes around
+	simulate({ .seed = 100, .firstFrame = 300 });
+	// a flaky connection, and a player pausing over the top of it
+	simulate({ .seed = 101, .spanNum = 2000, .stallChance = 5 });
+	simulate({ .seed = 102, .spanNum = 2000, .isTwoPlayer = true, .stallChance = 3, .pauseChance = 1 });
+	// the shortest script there is
+	simulate({ .seed = 103, .spanNum = 1 });
+	// stopped and started over partway through, with the old replay's frames still coming in
+	simulate({ .seed = 104, .restartFrame = 200 });
+	simulate({ .seed = 105, .spanNum = 2000, .isTwoPlayer = true, .stallChance = 3, .restartFrame = 1500 });
+	return 0;
+}
@@ -4,16 +4,26 @@ use futures_util::{
 	FutureExt,
 	future::{Either, select},
 };
-use tas_script_formats::{ControllerType, STASButtons, Script};
-use tokio::{sync::mpsc, time::Instant};
+use tas_script_formats::{
+	ChangeStage, ControllerType, Frame, Gyro, STASButtons, Script, glam::Vec3,
+};
+use tokio::{
+	sync::{mpsc, watch},
+	time::Instant,
+};
 use tracing::{info, warn};
-use zerocopy::FromZeros;
+use zerocopy::{FromZeros, Unalign};
 
-use crate::server::{ToServer, ToUi, protocol::Controller};
+use crate::server::{
+	FrameCredit, ToServer, ToUi,
+	protocol::{Controller, FramePacket},
+};
 
 pub enum ScriptMessage {
 	Script(Arc<Script>),
 	Start,
+	Cache,
+	StartCached,
 	Stop { manual: bool },
 	BackOff { server_index: u32 },
 }
@@ -23,6 +33,8 @@ impl Debug for ScriptMessage {
 		match self {
 			Self::Script(_) => f.debug_tuple("Script").finish(),
 			Self::Start => write!(f, "Start"),
+			Self::Cache => write!(f, "Cache"),
+			Self::StartCached => write!(f, "StartCached"),
 			Self::Stop { .. } => write!(f, "Stop"),
 			Self::BackOff { server_index } => f
 				.debug_struct("BackOff")
@@ -32,10 +44,131 @@ impl Debug for ScriptMessage {
 	}
 }
 
+/// Most frames sent per tick. The client's credit is the real limit, this only bounds the size
+/// of a single FrameDelta packet to what the client can receive in one go.
+const MAX_FRAMES_PER_TICK: u32 = 64;
+
+/// Credit assumed before the client has reported any for the current replay. The client's
+/// frame buffer is empty when it starts a replay and holds at least this many frames.
+const INITIAL_CREDIT: u32 = 32;
+
+/// How many more frames can be sent without overflowing the client's frame buffer, given
+/// that `sent` frames of replay `replay_id` have been sent so far.
+fn available_credit(credit: &FrameCredit, replay_id: u32, sent: u32) -> u32 {
+	if credit.replay_id != replay_id {
+		return INITIAL_CREDIT.saturating_sub(sent);
+	}
+	// the client can't have released frames it was never sent
+	let released = credit.frames_released.min(sent);
+	credit.buffer_capacity.saturating_sub(sent - released)
+}
+
+pub(crate) fn build_frame(
+	script: &Script,
+	server_index: u32,
+	frame: &Frame,
+	mut on_change_stage: impl FnMut(&ChangeStage),
+) -> FramePacket {
+	let next_frame_index = script
+		.frames
+		.get(server_index as usize + 1)
+		.map(|frame| frame.idx as u32)
+		.unwrap_or(u32::MAX);
+	// println!("{} {}", frame.idx, next_frame_index);
+
+	let mut player_1 = Controller::new_zeroed();
+	let mut player_2 = Controller::new_zeroed();
+	let mut amiibo = 0u64;
+
+	for command in &frame.commands {
+		match command {
+			tas_script_formats::Command::Controller(controller) => {
+				let player = match controller.player_id {
+					0 => &mut player_1,
+					1 => &mut player_2,
+					id => {
+						warn!("unexpected player {id} in tas script");
+						continue;
+					}
+				};
+				let buttons = controller
+					.buttons
+					.unwrap_or(tas_script_formats::Buttons::new());
+				player.buttons = STASButtons::from_internal(buttons);
+				player.left_stick = controller.left_stick.unwrap_or_default();
+				player.right_stick = controller.right_stick.unwrap_or_default();
+				player.accel_left = controller.left_accel.unwrap_or_default();
+				player.accel_right = controller.right_accel.unwrap_or_default();
+			}
+			tas_script_formats::Command::Amiibo { model_info } => amiibo = *model_info,
+			tas_script_formats::Command::Touch(_) => todo!("touch unsupported"),
+			tas_script_formats::Command::Save => todo!("saves"),
+			tas_script_formats::Command::ChangeStage(change_stage) => on_change_stage(change_stage),
+			tas_script_formats::Command::TeleportMario {
+				position: _,
+				rotation: _,
+			} => {
+				todo!()
+			}
+			tas_script_formats::Command::TeleportCappy {
+				position: _,
+				rotation: _,
+			} => {
+				todo!()
+			}
+			tas_script_formats::Command::Comment(_) => {}
+		}
+	}
+
+	FramePacket {
+		frame_index: (frame.idx as u32).into(),
+		next_frame_index: next_frame_index.into(),
+		server_index: server_index.into(),
+		player_1: Unalign::new(player_1),
+		player_2: Unalign::new(player_2),
+		amiibo: amiibo.into(),
+	}
+}
+
+/// Whether any frame of `script` moves a gyro, which the client has nowhere to apply. Some
+/// formats fill in gyro on every frame, so only a nonzero angular velocity counts.
+pub(crate) fn uses_gyro(script: &Script) -> bool {
+	let moves = |gyro: &Option<Gyro>| {
+		gyro.as_ref()
+			.is_some_and(|gyro| gyro.angular_v != Vec3::ZERO)
+	};
+	script
+		.frames
+		.iter()
+		.flat_map(|frame| &frame.commands)
+		.any(|command| match command {
+			tas_script_formats::Command::Controller(controller) => {
+				moves(&controller.left_gyro) || moves(&controller.right_gyro)
+			}
+			_ => false,
+		})
+}
+
+fn player_count(script: &Script) -> u8 {
+	if script.is_two_player { 2 } else { 1 }
+}
+
+fn controller_types(script: &Script) -> [u8; 2] {
+	[
+		script.controller_types.get(0).cloned().expect("no players") as _,
+		script
+			.controller_types
+			.get(1)
+			.cloned()
+			.unwrap_or(ControllerType::None) as _,
+	]
+}
+
 pub async fn script_sender(
 	mut from_ui: mpsc::Receiver<ScriptMessage>,
 	to_ui: mpsc::UnboundedSender<ToUi>,
 	to_server: mpsc::UnboundedSender<ToServer>,
+	credit: watch::Receiver<FrameCredit>,
 ) {
 	// 62.5ms (sending at 16hz)
 	let mut interval = tokio::time::interval(Duration::from_micros(62500));
@@ -45,6 +178,9 @@ pub async fn script_sender(
 	let mut stopped = false;
 	let mut back_off = None;
 	let mut current_frame = 0u32;
+	let mut replay_id = 0u32;
+	// frames sent since the current replay started, including any that were re-sent after a back-off
+	let mut sent = 0u32;
 	loop {
 		let sleep = running
 			.then(|| {
@@ -59,80 +195,47 @@ pub async fn script_sender(
 		match select(pin!(from_ui.recv()), pin!(sleep)).await {
 			Either::Right((_, _)) => {
 				back_off = None;
-				info!("sending frames {}", current_frame);
 
 				let script = current_script
 					.as_ref()
 					.expect("script must be set to be running");
 
-				for _ in 0..4 {
+				let frame_count =
+					available_credit(&credit.borrow(), replay_id, sent).min(MAX_FRAMES_PER_TICK);
+				if frame_count == 0 {
+					continue;
+				}
+				info!("sending {frame_count} frames from {current_frame}");
+
+				let mut batch = Vec::with_capacity(frame_count as usize);
+				for _ in 0..frame_count {
 					let Some(frame) = script.frames.get(current_frame as usize) else {
 						running = false;
 						break;
 					};
-					let next_frame_index = script
-						.frames
-						.get(current_frame as usize + 1)
-						.map(|frame| frame.idx as u32)
-						.unwrap_or(u32::MAX);
-					// println!("{} {}", frame.idx, next_frame_index);
-
-					let mut player_1 = Controller::new_zeroed();
-					let mut player_2 = Controller::new_zeroed();
-					let mut amiibo = 0u64;
-
-					for command in &frame.commands {
-						match command {
-							tas_script_formats::Command::Controller(controller) => {
-								let player = match controller.player_id {
-									0 => &mut player_1,
-									1 => &mut player_2,
-									id => {
-										warn!("unexpected player {id} in tas script");
-										continue;
-									}
-								};
-								let buttons = controller
-									.buttons
-									.unwrap_or(tas_script_formats::Buttons::new());
-								player.buttons = STASButtons::from_internal(buttons);
-								player.left_stick = controller.left_stick.unwrap_or_default();
-								player.right_stick = controller.right_stick.unwrap_or_default();
-							}
-							tas_script_formats::Command::Amiibo { model_info } => {
-								amiibo = *model_info
-							}
-							tas_script_formats::Command::Touch(_) => todo!("touch unsupported"),
-							tas_script_formats::Command::Save => todo!("saves"),
-							tas_script_formats::Command::ChangeStage(change_stage) => to_server
-								.send(ToServer::ChangeStage(change_stage.clone()))
-								.expect("channel closed"),
-							tas_script_formats::Command::TeleportMario {
-								position: _,
-								rotation: _,
-							} => {
-								todo!()
-							}
-							tas_script_formats::Command::TeleportCappy {
-								position: _,
-								rotation: _,
-							} => {
-								todo!()
-							}
-							tas_script_formats::Command::Comment(_) => {}
-						}
+					// frames before a stage change have to reach the client before the change does
+					let changes_stage = frame.commands.iter().any(|command| {
+						matches!(command, tas_script_formats::Command::ChangeStage(_))
+					});
+					if changes_stage && !batch.is_empty() {
+						to_server
+							.send(ToServer::FrameBatch(std::mem::take(&mut batch)))
+							.expect("channel closed");
 					}
+
+					batch.push(build_frame(script, current_frame, frame, |change_stage| {
+						to_server
+							.send(ToServer::ChangeStage(change_stage.clone()))
+							.expect("channel closed")
+					}));
+					current_frame += 1;
+					sent += 1;
+				}
+
+				if !batch.is_empty() {
 					to_server
-						.send(ToServer::Frame {
-							frame_index: frame.idx as u32,
-							next_frame_index,
-							server_index: current_frame,
-							player_1,
-							player_2,
-							amiibo,
-						})
+						.send(ToServer::FrameBatch(batch))
 						.expect("channel closed");
-					current_frame += 1;
 				}
 			}
 			Either::Left((message, _)) => {
@@ -145,16 +248,8 @@ pub async fn script_sender(
 						to_server
 							.send(ToServer::ScriptInfo {
 								frame_count: script.frames.len() as _,
-								player_count: if script.is_two_player { 2 } else { 1 },
-								controller_types: [
-									script.controller_types.get(0).cloned().expect("no players")
-										as _,
-									script
-										.controller_types
-										.get(1)
-										.cloned()
-										.unwrap_or(ControllerType::None) as _,
-								],
+								player_count: player_count(&script),
+								controller_types: controller_types(&script),
 							})
 							.expect("channel closed");
 						current_script = Some(script);
@@ -171,11 +266,43 @@ pub async fn script_sender(
 							} else {
 								// to_server.send(ToServer::ReloadStage).expect("channel closed");
 							}
+							replay_id = replay_id.wrapping_add(1);
+							sent = 0;
 							to_server
-								.send(ToServer::StartScript)
+								.send(ToServer::StartScript { replay_id })
 								.expect("channel closed");
 						}
 					}
+					ScriptMessage::Cache => {
+						let Some(script) = &current_script else {
+							continue;
+						};
+						let frames = script
+							.frames
+							.iter()
+							.enumerate()
+							.map(|(index, frame)| {
+								build_frame(script, index as u32, frame, |_| {
+									warn!("stage changes mid-script aren't cached")
+								})
+							})
+							.collect();
+						to_server
+							.send(ToServer::CacheScript {
+								frame_count: script.frames.len() as _,
+								player_count: player_count(script),
+								controller_types: controller_types(script),
+								frames,
+							})
+							.expect("channel closed");
+					}
+					ScriptMessage::StartCached => {
+						running = false;
+						stopped = false;
+						to_server
+							.send(ToServer::StartCachedScript)
+							.expect("channel closed");
+					}
 					ScriptMessage::Stop { manual } => {
 						running = false;
 						stopped = true;
@@ -191,6 +318,8 @@ pub async fn script_sender(
 						if stopped || to >= current_frame {
 							continue;
 						}
+						// the dropped frames never made it into the client's buffer, so they won't be released either
+						sent = sent.saturating_sub(current_frame - to);
 						current_frame = to;
 						running = true;
 						warn!("backed off");
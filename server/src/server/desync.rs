@@ -0,0 +1,267 @@
+//! Desync detection, from the state hash in each [`TelemetryRecord`].
+//!
+//! Every replay is checked against a reference run of the same script, picked out by a hash of
+//! the script file's contents so an edited script never gets compared against runs of the old one.
+//! The game is deterministic, so two replays of the same script hash the same on every frame, and
+//! the first frame where they don't is where one of them desynced.
+//!
+//! A script's first replay becomes its reference. After that a replay only ever adds frames the
+//! reference doesn't have yet, and only if it never diverged, so a desynced run can't replace a
+//! good one. The user can pin a reference so nothing changes it, or clear it so the next replay
+//! starts a new one.
+
+use std::{
+	collections::HashMap,
+	hash::{DefaultHasher, Hasher},
+	mem,
+};
+
+use tracing::warn;
+
+use crate::server::protocol::TelemetryRecord;
+
+/// Frame indices past this are ignored rather than growing the tables without bound
+const MAX_FRAMES: u32 = 1 << 22;
+
+/// Identifies a script by its contents. Only stable within one run of the server, which is as
+/// long as references are kept.
+pub type ScriptKey = u64;
+
+pub fn script_key(contents: &[u8]) -> ScriptKey {
+	let mut hasher = DefaultHasher::new();
+	hasher.write(contents);
+	hasher.finish()
+}
+
+pub enum DesyncMessage {
+	/// The script the next replay plays, or `None` if it isn't known, e.g. a script cached on the
+	/// console in an earlier session. Replays of unknown scripts aren't checked.
+	Script(Option<ScriptKey>),
+	/// Stop later replays from adding to the script's reference, or let them again
+	Pin { script: ScriptKey, pinned: bool },
+	/// Forget the script's reference, pinned or not
+	Clear(ScriptKey),
+}
+
+#[derive(Default)]
+struct Reference {
+	/// Hash of every frame, by frame index
+	hashes: Vec<Option<u32>>,
+	/// Only takes effect once there are hashes to keep
+	pinned: bool,
+}
+
+pub struct DesyncChecker {
+	/// Set while the client is replaying, along with the id of that replay
+	replay_id: Option<u32>,
+	/// Script of the next replay, as last told by the ui
+	next_script: Option<ScriptKey>,
+	/// Script of the replay in progress
+	script: Option<ScriptKey>,
+	references: HashMap<ScriptKey, Reference>,
+	current: Vec<Option<u32>>,
+	/// Frame index and hash of the latest record. The scene can update more than once on the same
+	/// frame index, e.g. while a stage loads, so a frame is only compared once the next one starts
+	pending: Option<(u32, u32)>,
+	/// Only the first divergence of a replay is reported, everything after it follows from it
+	diverged: bool,
+}
+
+impl DesyncChecker {
+	pub fn new() -> Self {
+		Self {
+			replay_id: None,
+			next_script: None,
+			script: None,
+			references: HashMap::new(),
+			current: Vec::new(),
+			pending: None,
+			diverged: false,
+		}
+	}
+
+	pub fn handle(&mut self, message: DesyncMessage) {
+		match message {
+			DesyncMessage::Script(script) => self.next_script = script,
+			DesyncMessage::Pin { script, pinned } => {
+				self.references.entry(script).or_default().pinned = pinned
+			}
+			DesyncMessage::Clear(script) => {
+				self.references.remove(&script);
+			}
+		}
+	}
+
+	/// Returns the frame index of the first frame that didn't match the reference run, at most
+	/// once per replay
+	pub fn push(&mut self, record: &TelemetryRecord) -> Option<u32> {
+		if record.flags & TelemetryRecord::REPLAYING == 0 {
+			if self.replay_id.take().is_some() {
+				self.finish_replay();
+			}
+			return None;
+		}
+		// cached scripts replay under the id of the last streamed one, so a replay starting is
+		// noticed from the flag as well as the id
+		if self.replay_id != Some(record.replay_id) {
+			if self.replay_id.is_some() {
+				self.finish_replay();
+			}
+			self.replay_id = Some(record.replay_id);
+			self.script = self.next_script;
+			self.diverged = false;
+		}
+		if record.flags & TelemetryRecord::HAS_STATE_HASH == 0 {
+			return None;
+		}
+
+		let pending = self
+			.pending
+			.replace((record.frame_index, record.state_hash));
+		match pending {
+			Some((frame_index, hash)) if frame_index != record.frame_index => {
+				self.finish_frame(frame_index, hash)
+			}
+			_ => None,
+		}
+	}
+
+	fn finish_replay(&mut self) {
+		// the last frame is kept, but not compared since it may not have finished
+		if let Some((frame_index, hash)) = self.pending.take() {
+			self.store(frame_index, hash);
+		}
+		let current = mem::take(&mut self.current);
+		// a replay that never got to a single frame doesn't start a reference either
+		if self.diverged || current.is_empty() {
+			return;
+		}
+		let Some(script) = self.script else {
+			return;
+		};
+
+		let reference = self.references.entry(script).or_default();
+		if reference.pinned && !reference.hashes.is_empty() {
+			return;
+		}
+		if reference.hashes.len() < current.len() {
+			reference.hashes.resize(current.len(), None);
+		}
+		// the replay matched wherever both have a frame, so only the frames the reference is
+		// missing are taken from it
+		for (expected, hash) in reference.hashes.iter_mut().zip(current) {
+			if expected.is_none() {
+				*expected = hash;
+			}
+		}
+	}
+
+	fn finish_frame(&mut self, frame_index: u32, hash: u32) -> Option<u32> {
+		self.store(frame_index, hash);
+		if self.diverged {
+			return None;
+		}
+
+		let expected = self
+			.references
+			.get(&self.script?)?
+			.hashes
+			.get(frame_index as usize)
+			.copied()
+			.flatten()?;
+		if expected == hash {
+			return None;
+		}
+
+		self.diverged = true;
+		warn!(
+			"desync at frame {frame_index}: state hash {hash:08x}, reference run had {expected:08x}"
+		);
+		Some(frame_index)
+	}
+
+	fn store(&mut self, frame_index: u32, hash: u32) {
+		if frame_index >= MAX_FRAMES {
+			return;
+		}
+		let index = frame_index as usize;
+		if self.current.len() <= index {
+			self.current.resize(index + 1, None);
+		}
+		self.current[index] = Some(hash);
+	}
+}
+
+#[cfg(test)]
+mod tests {
+	use zerocopy::FromZeros;
+
+	use super::*;
+
+	const SCRIPT: ScriptKey = 1;
+	const EDITED: ScriptKey = 2;
+
+	/// Replays `hashes`, one frame each, and returns the first desync reported
+	fn replay(checker: &mut DesyncChecker, replay_id: u32, hashes: &[u32]) -> Option<u32> {
+		let mut record = TelemetryRecord::new_zeroed();
+		record.replay_id = replay_id;
+		record.flags = TelemetryRecord::REPLAYING | TelemetryRecord::HAS_STATE_HASH;
+		let mut desync = None;
+		for (frame_index, &hash) in hashes.iter().enumerate() {
+			record.frame_index = frame_index as u32;
+			record.state_hash = hash;
+			desync = desync.or(checker.push(&record));
+		}
+		record.flags = 0;
+		checker.push(&record);
+		desync
+	}
+
+	#[test]
+	fn keyed_by_script() {
+		let mut checker = DesyncChecker::new();
+		checker.handle(DesyncMessage::Script(Some(SCRIPT)));
+		assert_eq!(replay(&mut checker, 1, &[1, 2, 3, 4]), None);
+		assert_eq!(replay(&mut checker, 2, &[1, 2, 3, 4]), None);
+
+		// an edited script starts a reference of its own instead of desyncing
+		checker.handle(DesyncMessage::Script(Some(EDITED)));
+		assert_eq!(replay(&mut checker, 3, &[1, 9, 9, 9]), None);
+		checker.handle(DesyncMessage::Script(Some(SCRIPT)));
+		assert_eq!(replay(&mut checker, 4, &[1, 2, 5, 4]), Some(2));
+
+		// unknown scripts aren't checked
+		checker.handle(DesyncMessage::Script(None));
+		assert_eq!(replay(&mut checker, 5, &[7, 7, 7]), None);
+	}
+
+	#[test]
+	fn diverged_replays_never_become_the_reference() {
+		let mut checker = DesyncChecker::new();
+		checker.handle(DesyncMessage::Script(Some(SCRIPT)));
+		assert_eq!(replay(&mut checker, 1, &[1, 2, 3]), None);
+		assert_eq!(replay(&mut checker, 2, &[1, 5, 6, 7, 8]), Some(1));
+		assert_eq!(replay(&mut checker, 3, &[1, 2, 3]), None);
+
+		// a clean replay that goes further only adds to the reference
+		assert_eq!(replay(&mut checker, 4, &[1, 2, 3, 4, 5, 6]), None);
+		assert_eq!(replay(&mut checker, 5, &[1, 2, 3, 4, 0, 6]), Some(4));
+	}
+
+	#[test]
+	fn pin_and_clear() {
+		let mut checker = DesyncChecker::new();
+		checker.handle(DesyncMessage::Script(Some(SCRIPT)));
+		assert_eq!(replay(&mut checker, 1, &[1, 2]), None);
+		checker.handle(DesyncMessage::Pin {
+			script: SCRIPT,
+			pinned: true,
+		});
+		assert_eq!(replay(&mut checker, 2, &[1, 2, 3, 4]), None);
+		assert_eq!(replay(&mut checker, 3, &[1, 2, 5, 6]), None);
+
+		checker.handle(DesyncMessage::Clear(SCRIPT));
+		assert_eq!(replay(&mut checker, 4, &[1, 3, 3]), None);
+		assert_eq!(replay(&mut checker, 5, &[1, 2, 3]), Some(1));
+	}
+}
@@ -0,0 +1,494 @@
+//! Delta encoding for frame batches, decoded by the client's `framedelta::Decoder`.
+//!
+//! A packet is a [`FrameDeltaHeader`] followed by one record per frame:
+//! a `u16` dirty mask, a LEB128 run length (`next_frame_index - frame_index`, or 0 if there is
+//! no next frame), then the raw bytes of each changed field in [`FIELDS`] order.
+//! The first record is relative to an all-zero frame so every packet decodes on its own,
+//! which keeps back-offs and restarts simple.
+
+use std::{mem::offset_of, ops::Range};
+
+use tas_script_formats::{
+	STASButtons,
+	glam::{IVec2, Vec3},
+};
+use zerocopy::{
+	FromZeros, IntoBytes,
+	little_endian::{U16, U64},
+};
+
+use crate::server::protocol::{Controller, FrameDeltaHeader, FramePacket};
+
+/// A byte range within a [`FramePacket`] that is sent only when it changes.
+#[derive(Clone, Copy)]
+pub struct Field {
+	offset: usize,
+	size: usize,
+}
+
+impl Field {
+	const fn new(offset: usize, size: usize) -> Self {
+		Self { offset, size }
+	}
+
+	fn range(self) -> Range<usize> {
+		self.offset..self.offset + self.size
+	}
+}
+
+const fn controller_fields(base: usize) -> [Field; 5] {
+	[
+		Field::new(
+			base + offset_of!(Controller, buttons),
+			size_of::<STASButtons>(),
+		),
+		Field::new(
+			base + offset_of!(Controller, left_stick),
+			size_of::<IVec2>(),
+		),
+		Field::new(
+			base + offset_of!(Controller, right_stick),
+			size_of::<IVec2>(),
+		),
+		Field::new(base + offset_of!(Controller, accel_left), size_of::<Vec3>()),
+		Field::new(
+			base + offset_of!(Controller, accel_right),
+			size_of::<Vec3>(),
+		),
+	]
+}
+
+/// One entry per dirty mask bit. Must match the client's `cFields`.
+pub const FIELDS: [Field; 11] = {
+	let [p1_0, p1_1, p1_2, p1_3, p1_4] = controller_fields(offset_of!(FramePacket, player_1));
+	let [p2_0, p2_1, p2_2, p2_3, p2_4] = controller_fields(offset_of!(FramePacket, player_2));
+	let amiibo = Field::new(offset_of!(FramePacket, amiibo), size_of::<U64>());
+	[
+		p1_0, p1_1, p1_2, p1_3, p1_4, p2_0, p2_1, p2_2, p2_3, p2_4, amiibo,
+	]
+};
+
+fn write_var_int(out: &mut Vec<u8>, mut value: u32) {
+	loop {
+		let byte = (value & 0x7f) as u8;
+		value >>= 7;
+		if value == 0 {
+			out.push(byte);
+			return;
+		}
+		out.push(byte | 0x80);
+	}
+}
+
+/// Encodes consecutive frames (as sent by the script sender) into a `FrameDelta` packet body.
+pub fn encode(frames: &[FramePacket]) -> Vec<u8> {
+	let mut out = Vec::new();
+	let Some(first) = frames.first() else {
+		return out;
+	};
+
+	out.extend_from_slice(
+		FrameDeltaHeader {
+			server_index: first.server_index,
+			frame_index: first.frame_index,
+			frame_count: U16::new(frames.len() as u16),
+		}
+		.as_bytes(),
+	);
+
+	let zeroed = FramePacket::new_zeroed();
+	let mut prev = zeroed.as_bytes();
+	for frame in frames {
+		let cur = frame.as_bytes();
+
+		let mask = FIELDS
+			.iter()
+			.enumerate()
+			.filter(|(_, field)| cur[field.range()] != prev[field.range()])
+			.fold(0u16, |mask, (i, _)| mask | (1 << i));
+		out.extend_from_slice(&mask.to_le_bytes());
+
+		let next_frame_index = frame.next_frame_index.get();
+		let run = if next_frame_index == u32::MAX {
+			0
+		} else {
+			next_frame_index - frame.frame_index.get()
+		};
+		write_var_int(&mut out, run);
+
+		for (i, field) in FIELDS.iter().enumerate() {
+			if mask & (1 << i) != 0 {
+				out.extend_from_slice(&cur[field.range()]);
+			}
+		}
+
+		prev = cur;
+	}
+
+	out
+}
+
+#[cfg(test)]
+mod tests {
+	use std::{env, fs};
+
+	use tas_script_formats::{Buttons, Command, ControllerType, Frame, Script, parse, parse_stas};
+	use zerocopy::{FromBytes, little_endian::U32};
+
+	use super::*;
+	use crate::script_sender::build_frame;
+
+	/// Mirror of the client's `framedelta::Decoder`, kept as close to it as possible so the
+	/// round trip exercises the same rules the console applies.
+	struct Decoder<'a> {
+		data: &'a [u8],
+		prev: FramePacket,
+		remaining: u16,
+	}
+
+	impl<'a> Decoder<'a> {
+		fn new(data: &'a [u8]) -> Option<Self> {
+			let (header, data) = FrameDeltaHeader::read_from_prefix(data).ok()?;
+
+			// primed so the first record picks up frame_index/server_index from the header
+			let mut prev = FramePacket::new_zeroed();
+			prev.next_frame_index = header.frame_index;
+			prev.server_index = U32::new(header.server_index.get().wrapping_sub(1));
+			Some(Self {
+				data,
+				prev,
+				remaining: header.frame_count.get(),
+			})
+		}
+
+		fn take(&mut self, size: usize) -> Option<&'a [u8]> {
+			let (bytes, rest) = self.data.split_at_checked(size)?;
+			self.data = rest;
+			Some(bytes)
+		}
+
+		fn read_var_int(&mut self) -> Option<u32> {
+			let mut value = 0u32;
+			for i in 0..5 {
+				let byte = self.take(1)?[0];
+				value |= u32::from(byte & 0x7f) << (i * 7);
+				if byte & 0x80 == 0 {
+					return Some(value);
+				}
+			}
+			None
+		}
+
+		fn next(&mut self) -> Option<FramePacket> {
+			if self.remaining == 0 {
+				return None;
+			}
+
+			let mask = u16::from_le_bytes(self.take(2)?.try_into().unwrap());
+			let run = self.read_var_int()?;
+
+			let mut out = FramePacket::read_from_bytes(self.prev.as_bytes()).unwrap();
+			let frame_index = self.prev.next_frame_index.get();
+			out.frame_index = U32::new(frame_index);
+			out.next_frame_index = U32::new(if run == 0 {
+				u32::MAX
+			} else {
+				frame_index + run
+			});
+			out.server_index = U32::new(self.prev.server_index.get().wrapping_add(1));
+
+			for (i, field) in FIELDS.iter().enumerate() {
+				if mask & (1 << i) != 0 {
+					let bytes = self.take(field.size)?;
+					out.as_mut_bytes()[field.range()].copy_from_slice(bytes);
+				}
+			}
+
+			self.prev = FramePacket::read_from_bytes(out.as_bytes()).unwrap();
+			self.remaining -= 1;
+			Some(out)
+		}
+	}
+
+	/// Small deterministic generator, so a failing case can be reproduced from its seed
+	struct Lcg(u64);
+
+	impl Lcg {
+		fn next(&mut self) -> u32 {
+			self.0 = self
+				.0
+				.wrapping_mul(6364136223846793005)
+				.wrapping_add(1442695040888963407);
+			(self.0 >> 32) as u32
+		}
+
+		fn below(&mut self, n: u32) -> u32 {
+			self.next() % n
+		}
+	}
+
+	fn build_frames(script: &Script) -> Vec<FramePacket> {
+		script
+			.frames
+			.iter()
+			.enumerate()
+			.map(|(i, frame)| build_frame(script, i as u32, frame, |_| {}))
+			.collect()
+	}
+
+	/// Encodes `frames` in packets of `batch` frames, the way the script sender batches them,
+	/// and checks every packet decodes back to exactly what went in
+	fn check_round_trip(frames: &[FramePacket], batch: usize) {
+		for (packet_idx, packet) in frames.chunks(batch).enumerate() {
+			let body = encode(packet);
+			let mut decoder = Decoder::new(&body).expect("packet has no header");
+			for (i, expected) in packet.iter().enumerate() {
+				let decoded = decoder.next().unwrap_or_else(|| {
+					panic!("packet {packet_idx} (batch {batch}) ended early at record {i}")
+				});
+				assert_eq!(
+					decoded.as_bytes(),
+					expected.as_bytes(),
+					"packet {packet_idx} (batch {batch}) record {i} decoded differently"
+				);
+			}
+			assert!(
+				decoder.next().is_none(),
+				"packet {packet_idx} has extra records"
+			);
+			assert!(
+				decoder.data.is_empty(),
+				"packet {packet_idx} has trailing bytes"
+			);
+		}
+	}
+
+	fn check_script(script: &Script) {
+		let frames = build_frames(script);
+		for batch in [1, 7, 64, frames.len().max(1)] {
+			check_round_trip(&frames, batch);
+		}
+	}
+
+	fn random_controller(rng: &mut Lcg, player_id: u8) -> tas_script_formats::Controller {
+		let mut controller = tas_script_formats::Controller::new(player_id);
+		// most frames hold the same inputs as the one before, which is what the delta relies on,
+		// so only some of them get a controller command at all
+		controller.buttons = Some(Buttons::from_bits(u64::from(rng.next() & 0x1ffff)));
+		if rng.below(2) == 0 {
+			let stick = rng.next();
+			controller.left_stick = Some(IVec2::new(
+				(stick & 0xffff) as i16 as i32,
+				(stick >> 16) as i16 as i32,
+			));
+		}
+		if rng.below(4) == 0 {
+			controller.right_stick = Some(IVec2::new(32767, -32768));
+		}
+		controller
+	}
+
+	fn random_script(seed: u64, frame_count: usize, is_two_player: bool) -> Script {
+		let mut rng = Lcg(seed);
+		let mut idx = 0;
+		let frames = (0..frame_count)
+			.map(|_| {
+				// scripts skip frames that repeat the previous inputs, sometimes by a lot
+				idx += match rng.below(8) {
+					0 => 1 + rng.below(1 << 20) as usize,
+					1..3 => 2 + rng.below(100) as usize,
+					_ => 1,
+				};
+				let mut commands = vec![];
+				if rng.below(3) != 0 {
+					commands.push(Command::Controller(random_controller(&mut rng, 0)));
+				}
+				if is_two_player && rng.below(3) == 0 {
+					commands.push(Command::Controller(random_controller(&mut rng, 1)));
+				}
+				if rng.below(50) == 0 {
+					commands.push(Command::Amiibo {
+						model_info: u64::from(rng.next()) << 32 | u64::from(rng.next()),
+					});
+				}
+				Frame { idx, commands }
+			})
+			.collect();
+
+		Script {
+			author: None,
+			seconds_spent_editing: None,
+			is_two_player,
+			controller_types: vec![ControllerType::Procon; if is_two_player { 2 } else { 1 }],
+			change_stage_info: None,
+			frames,
+		}
+	}
+
+	/// Writes a v0 STAS file, the format the client's own recorder produces
+	fn write_stas(rng: &mut Lcg, frame_count: u32) -> Vec<u8> {
+		let mut commands = Vec::new();
+		let mut command_count = 0u32;
+		let mut command = |kind: u16, body: &[u8]| {
+			commands.extend_from_slice(&kind.to_le_bytes());
+			commands.extend_from_slice(&(body.len() as u16).to_le_bytes());
+			commands.extend_from_slice(body);
+			command_count += 1;
+		};
+
+		let mut frame = 0;
+		for _ in 0..frame_count {
+			frame += 1 + rng.below(30);
+			command(0, &frame.to_le_bytes());
+
+			let mut body = vec![0, 0, 0, 0];
+			body.extend_from_slice(&u64::from(rng.next() & 0xffff).to_le_bytes());
+			for _ in 0..4 {
+				body.extend_from_slice(&(rng.next() as i16 as i32).to_le_bytes());
+			}
+			// the parser only takes the buttons and sticks from a player's second controller
+			// command in a frame, so every frame gets two
+			command(1, &body);
+			command(1, &body);
+
+			if rng.below(10) == 0 {
+				command(3, &u64::from(rng.next()).to_le_bytes());
+			}
+		}
+
+		let mut out = Vec::new();
+		out.extend_from_slice(b"STAS");
+		out.extend_from_slice(&0u16.to_le_bytes()); // format version
+		out.extend_from_slice(&0u16.to_le_bytes()); // addon version
+		out.extend_from_slice(&[0; 4]); // editor extras, padding
+		out.extend_from_slice(&0x0100000000010000u64.to_le_bytes());
+		out.extend_from_slice(&command_count.to_le_bytes());
+		out.extend_from_slice(&0u32.to_le_bytes()); // seconds edited
+		out.extend_from_slice(&[1, 0, 0, 0]); // player count, padding
+		out.extend_from_slice(&[ControllerType::Procon as u8, 0, 0, 0]);
+		out.extend_from_slice(&[0; 4]); // author name length, padding
+		out.extend_from_slice(&commands);
+		out
+	}
+
+	#[test]
+	fn round_trip_random_scripts() {
+		for seed in 0..32 {
+			check_script(&random_script(seed, 2000, seed % 2 == 1));
+		}
+	}
+
+	#[test]
+	fn round_trip_parsed_stas() {
+		let mut rng = Lcg(0x5745);
+		for frame_count in [2, 10, 60] {
+			let data = write_stas(&mut rng, frame_count);
+			let script = parse_stas(&data).expect("failed to parse generated STAS file");
+			assert!(!script.frames.is_empty());
+			check_script(&script);
+		}
+	}
+
+	/// Every field changing on its own
+	#[test]
+	fn round_trip_every_field() {
+		let mut frames = Vec::new();
+		for (i, field) in FIELDS.iter().enumerate() {
+			let mut frame = FramePacket::new_zeroed();
+			frame.frame_index = U32::new(i as u32);
+			frame.next_frame_index = U32::new(i as u32 + 1);
+			frame.server_index = U32::new(i as u32);
+			frame.as_mut_bytes()[field.range()].fill(0xA5);
+			frames.push(frame);
+		}
+		frames.last_mut().unwrap().next_frame_index = U32::new(u32::MAX);
+		check_round_trip(&frames, frames.len());
+	}
+
+	/// The packet the client's framedelta_test expects for [`golden_frames`]. Keep in sync with
+	/// `cGoldenPacket` in client/test/framedelta_test.cpp, so the two encoders can't drift apart
+	#[rustfmt::skip]
+	const GOLDEN_PACKET: [u8; 148] = [
+		0x0a, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x03, 0x00, 0x03, 0x00, 0xc8, 0x01, 0x41, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0x38, 0xff, 0xff, 0xff, 0xff, 0x07,
+		0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x80, 0xff, 0xff, 0xff, 0x7f, 0x00,
+		0x00, 0x01, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x80,
+		0xbf, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x80, 0x3f, 0x00, 0x00, 0x80, 0x3f, 0x00, 0x00, 0x80,
+		0x3f, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00,
+		0x00, 0xf7, 0xff, 0xff, 0xff, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x80, 0xbf, 0x00, 0x00, 0x80, 0xbf, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00,
+	];
+
+	fn put(frame: &mut FramePacket, field: usize, bytes: &[u8]) {
+		let range = FIELDS[field].range();
+		assert_eq!(range.len(), bytes.len());
+		frame.as_mut_bytes()[range].copy_from_slice(bytes);
+	}
+
+	fn ints(values: &[i32]) -> Vec<u8> {
+		values.iter().flat_map(|v| v.to_le_bytes()).collect()
+	}
+
+	fn floats(values: &[f32]) -> Vec<u8> {
+		values.iter().flat_map(|v| v.to_le_bytes()).collect()
+	}
+
+	/// A held input, a frame where every field of both players changes, and the script's last frame
+	fn golden_frames() -> Vec<FramePacket> {
+		let mut first = FramePacket::new_zeroed();
+		first.frame_index = U32::new(5);
+		first.next_frame_index = U32::new(205);
+		first.server_index = U32::new(10);
+		put(&mut first, 0, &0x41u64.to_le_bytes());
+		put(&mut first, 1, &ints(&[100, -200]));
+
+		let mut every = FramePacket::read_from_bytes(first.as_bytes()).unwrap();
+		every.frame_index = U32::new(205);
+		every.next_frame_index = U32::new(206);
+		every.server_index = U32::new(11);
+		put(&mut every, 0, &0x8000000000000002u64.to_le_bytes());
+		put(&mut every, 1, &ints(&[-32768, 32767]));
+		put(&mut every, 2, &ints(&[1, -1]));
+		put(&mut every, 3, &floats(&[0.5, -1.0, 2.0]));
+		put(&mut every, 4, &floats(&[1.0, 1.0, 1.0]));
+		put(&mut every, 5, &0x10u64.to_le_bytes());
+		put(&mut every, 6, &ints(&[7, 8]));
+		put(&mut every, 7, &ints(&[-9, 10]));
+		put(&mut every, 8, &floats(&[0.0, 0.0, -1.0]));
+		put(&mut every, 9, &floats(&[-1.0, 0.0, 0.0]));
+		put(&mut every, 10, &0x0123456789ABCDEFu64.to_le_bytes());
+
+		let mut last = FramePacket::read_from_bytes(every.as_bytes()).unwrap();
+		last.frame_index = U32::new(206);
+		last.next_frame_index = U32::new(u32::MAX);
+		last.server_index = U32::new(12);
+		put(&mut last, 0, &0u64.to_le_bytes());
+
+		vec![first, every, last]
+	}
+
+	#[test]
+	fn matches_client_golden_packet() {
+		let frames = golden_frames();
+		assert_eq!(encode(&frames), GOLDEN_PACKET);
+		check_round_trip(&frames, frames.len());
+	}
+
+	/// Round trips every script in `CALYPSO_TEST_SCRIPTS`, for checking against real TASes
+	/// that can't be committed here
+	#[test]
+	fn round_trip_script_dir() {
+		let Ok(dir) = env::var("CALYPSO_TEST_SCRIPTS") else {
+			return;
+		};
+		for entry in fs::read_dir(dir).expect("failed to read CALYPSO_TEST_SCRIPTS") {
+			let path = entry.unwrap().path();
+			let data = fs::read(&path).unwrap();
+			let script =
+				parse(&data).unwrap_or_else(|e| panic!("failed to parse {}: {e}", path.display()));
+			check_script(&script);
+		}
+	}
+}
@@ -0,0 +1,123 @@
+//! Frame pacing, measured from the console's system tick in each [`TelemetryRecord`].
+//!
+//! The tick is taken when `GameSystem::movement` starts, so the difference between two
+//! consecutive records is how long that frame took on the console, however late the datagrams
+//! arrive. That tells lag frames (the console missed a vblank) apart from starvation (the client
+//! held the game back because its frame buffer was empty, flagged as [`TelemetryRecord::BLOCKED`]).
+
+use tracing::{info, warn};
+
+use crate::server::protocol::TelemetryRecord;
+
+/// The Switch's system counter runs at a fixed 19.2MHz
+const TICK_FREQUENCY: u64 = 19_200_000;
+const FRAME_TICKS: u64 = TICK_FREQUENCY / 60;
+/// 1ms histogram buckets, the last one also counts anything slower
+const BUCKET_TICKS: u64 = TICK_FREQUENCY / 1000;
+const BUCKET_COUNT: usize = 64;
+/// Frames between two logged summaries
+const SUMMARY_INTERVAL: u32 = 600;
+
+pub struct FrameTiming {
+	/// Sequence number and tick of the previous record
+	last: Option<(u32, u64)>,
+	was_blocked: bool,
+	histogram: [u32; BUCKET_COUNT],
+	frames: u32,
+	max_ticks: u64,
+	dropped_frames: u64,
+	blocked_frames: u32,
+	underruns: u32,
+}
+
+impl FrameTiming {
+	pub fn new() -> Self {
+		Self {
+			last: None,
+			was_blocked: false,
+			histogram: [0; BUCKET_COUNT],
+			frames: 0,
+			max_ticks: 0,
+			dropped_frames: 0,
+			blocked_frames: 0,
+			underruns: 0,
+		}
+	}
+
+	pub fn push(&mut self, record: &TelemetryRecord) {
+		let is_blocked = record.flags & TelemetryRecord::BLOCKED != 0;
+		if is_blocked {
+			self.blocked_frames += 1;
+			if !self.was_blocked {
+				self.underruns += 1;
+				warn!("frame buffer ran dry at frame {}", record.frame_index);
+			}
+		}
+		self.was_blocked = is_blocked;
+
+		// a frame time needs both ends, so nothing is measured across lost datagrams or a client restart
+		let last = self.last.replace((record.sequence, record.tick));
+		let Some((last_sequence, last_tick)) = last else {
+			return;
+		};
+		if record.sequence != last_sequence.wrapping_add(1) {
+			return;
+		}
+
+		let ticks = record.tick.wrapping_sub(last_tick);
+		let bucket = ((ticks / BUCKET_TICKS) as usize).min(BUCKET_COUNT - 1);
+		self.histogram[bucket] += 1;
+		self.max_ticks = self.max_ticks.max(ticks);
+		self.frames += 1;
+
+		// rounded to the nearest vblank, so ordinary jitter doesn't count
+		let dropped = ((ticks + FRAME_TICKS / 2) / FRAME_TICKS).saturating_sub(1);
+		if dropped > 0 {
+			self.dropped_frames += dropped;
+			warn!(
+				"lag: frame {} took {:.1}ms ({dropped} dropped)",
+				record.frame_index,
+				ticks_to_ms(ticks)
+			);
+		}
+
+		if self.frames >= SUMMARY_INTERVAL {
+			self.log_summary();
+			*self = Self {
+				last: self.last,
+				was_blocked: self.was_blocked,
+				..Self::new()
+			};
+		}
+	}
+
+	/// Upper bound of the bucket the `percentile`th frame time falls into, in ms
+	fn percentile(&self, percentile: u32) -> usize {
+		let target = (self.frames as u64 * percentile as u64).div_ceil(100);
+		let mut count = 0;
+		for (bucket, &frames) in self.histogram.iter().enumerate() {
+			count += frames as u64;
+			if count >= target {
+				return bucket + 1;
+			}
+		}
+		BUCKET_COUNT
+	}
+
+	fn log_summary(&self) {
+		info!(
+			"frame times over {} frames: p50 <{}ms, p99 <{}ms, max {:.1}ms, {} dropped, {} blocked in {} underruns",
+			self.frames,
+			self.percentile(50),
+			self.percentile(99),
+			ticks_to_ms(self.max_ticks),
+			self.dropped_frames,
+			self.blocked_frames,
+			self.underruns
+		);
+	}
+}
+
+fn ticks_to_ms(ticks: u64) -> f64 {
+	ticks as f64 * 1000.0 / TICK_FREQUENCY as f64
+}
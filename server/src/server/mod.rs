@@ -10,17 +10,24 @@ use tokio::{
 		TcpListener, UdpSocket,
 		tcp::{OwnedReadHalf, OwnedWriteHalf},
 	},
-	sync::{Mutex, mpsc},
+	sync::{Mutex, mpsc, watch},
 };
 use tokio_util::sync::CancellationToken;
 #[allow(unused_imports)]
 use tracing::{debug, error, info, warn};
-use zerocopy::{FromBytes, FromZeros, IntoBytes, Unalign, little_endian::U32};
+use zerocopy::{FromBytes, FromZeros, IntoBytes, little_endian::U32};
 
-use crate::server::protocol::{
-	Controller, FramePacket, InputReport, PacketHeader, PacketType, ScriptInfo, ToolType,
+use crate::server::{
+	desync::{DesyncChecker, DesyncMessage},
+	frame_timing::FrameTiming,
+	protocol::{
+		FramePacket, InputReport, PacketHeader, PacketType, ScriptInfo, TelemetryRecord, ToolType,
+	},
 };
 
+pub mod desync;
+pub mod frame_delta;
+pub mod frame_timing;
 pub mod protocol;
 
 pub enum ToServer {
@@ -31,22 +38,29 @@ pub enum ToServer {
 	},
 	ChangeStage(ChangeStage),
 	ReloadStage,
-	Frame {
-		frame_index: u32,
-		next_frame_index: u32,
-		server_index: u32,
-		player_1: Controller,
-		player_2: Controller,
-		amiibo: u64,
+	FrameBatch(Vec<FramePacket>),
+	/// Store the whole script on the client's SD card
+	CacheScript {
+		frame_count: u32,
+		player_count: u8,
+		controller_types: [u8; 2],
+		frames: Vec<FramePacket>,
 	},
+	StartCachedScript,
 	GetSave {
 		save_index: u8,
 	},
 	PauseGame,
 	AdvanceFrame,
-	StartScript,
+	StartScript {
+		replay_id: u32,
+	},
 	StopScript,
 	UpdateTool(ToolType, heapless::Vec<u8, 16>),
+	/// Pause the game, the replay's state stopped matching the reference run at `frame_index`
+	Desync {
+		frame_index: u32,
+	},
 }
 
 pub enum ToUi {
@@ -59,13 +73,28 @@ pub enum ToUi {
 	ReportStage { stage_name: String, scenario: i32 },
 	ReportPosition { position: Vec3 },
 	InputReport(InputReport),
+	Desync { frame_index: u32 },
+}
+
+/// Flow control state advertised by the client in its telemetry.
+#[derive(Clone, Copy, Default, Debug)]
+pub struct FrameCredit {
+	pub replay_id: u32,
+	/// Frames of this replay the client has taken out of its frame buffer
+	pub frames_released: u32,
+	pub buffer_capacity: u32,
 }
 
+/// Frames per block of a cached script. Must not exceed the client's `ScriptCache::cChunkFrameNum`.
+const CACHE_BLOCK_FRAMES: usize = 64;
+
 pub async fn server_task(
 	ui: mpsc::UnboundedSender<ToUi>,
 	server: mpsc::UnboundedReceiver<ToServer>,
+	credit: watch::Sender<FrameCredit>,
+	desync: mpsc::UnboundedReceiver<DesyncMessage>,
 ) {
-	tokio::spawn(udp_task(ui.clone()));
+	tokio::spawn(udp_task(ui.clone(), credit, desync));
 	let tcp_listener = TcpListener::bind("0.0.0.0:8171")
 		.await
 		.expect("failed to start tcp server on 8171");
@@ -216,24 +245,14 @@ async fn handle_message(client: &mut OwnedWriteHalf, message: ToServer) -> Resul
 			player_count,
 			controller_types,
 		} => {
-			client
-				.write_all(
-					PacketHeader {
-						packet_type: PacketType::ScriptInfo as _,
-						size: U32::new(size_of::<ScriptInfo>() as u32),
-					}
-					.as_bytes(),
-				)
-				.await
-				.context("failed to write script info packet header")?;
-			let mut script_info = ScriptInfo::new_zeroed();
-			script_info.frame_count = U32::new(frame_count);
-			script_info.player_count = player_count;
-			script_info.controller_types = controller_types;
-			client
-				.write_all(script_info.as_bytes())
-				.await
-				.context("failed to write script info")?;
+			write_script_info(
+				client,
+				PacketType::ScriptInfo,
+				frame_count,
+				player_count,
+				controller_types,
+			)
+			.await?
 		}
 		ToServer::ChangeStage(ChangeStage {
 			stage_name,
@@ -301,38 +320,75 @@ async fn handle_message(client: &mut OwnedWriteHalf, message: ToServer) -> Resul
 			)
 			.await
 			.context("failed to write pause packet")?,
-		ToServer::Frame {
-			frame_index,
-			next_frame_index,
-			server_index,
-			player_1,
-			player_2,
-			amiibo,
-		} => {
-			let packet = FramePacket {
-				frame_index: frame_index.into(),
-				next_frame_index: next_frame_index.into(),
-				server_index: server_index.into(),
-				player_1: Unalign::new(player_1),
-				player_2: Unalign::new(player_2),
-				amiibo: amiibo.into(),
-			};
-
+		ToServer::FrameBatch(frames) => {
+			let body = frame_delta::encode(&frames);
 			client
 				.write_all(
 					PacketHeader {
-						packet_type: PacketType::Frame as _,
-						size: U32::new(size_of::<FramePacket>() as u32),
+						packet_type: PacketType::FrameDelta as _,
+						size: U32::new(body.len() as u32),
 					}
 					.as_bytes(),
 				)
 				.await
-				.context("failed to write script info packet header")?;
+				.context("failed to write frame delta packet header")?;
 			client
-				.write_all(packet.as_bytes())
+				.write_all(&body)
 				.await
-				.context("failed to write frame count")?;
+				.context("failed to write frame delta")?;
 		}
+		ToServer::CacheScript {
+			frame_count,
+			player_count,
+			controller_types,
+			frames,
+		} => {
+			write_script_info(
+				client,
+				PacketType::CacheBegin,
+				frame_count,
+				player_count,
+				controller_types,
+			)
+			.await?;
+			for block in frames.chunks(CACHE_BLOCK_FRAMES) {
+				let body = frame_delta::encode(block);
+				client
+					.write_all(
+						PacketHeader {
+							packet_type: PacketType::CacheBlock as _,
+							size: U32::new(body.len() as u32),
+						}
+						.as_bytes(),
+					)
+					.await
+					.context("failed to write cache block packet header")?;
+				client
+					.write_all(&body)
+					.await
+					.context("failed to write cache block")?;
+			}
+			client
+				.write_all(
+					PacketHeader {
+						packet_type: PacketType::CacheEnd as _,
+						size: 0.into(),
+					}
+					.as_bytes(),
+				)
+				.await
+				.context("failed to write cache end packet")?
+		}
+		ToServer::StartCachedScript => client
+			.write_all(
+				PacketHeader {
+					packet_type: PacketType::StartCachedScript as _,
+					size: 0.into(),
+				}
+				.as_bytes(),
+			)
+			.await
+			.context("failed to write start cached packet")?,
 		ToServer::GetSave { save_index: _ } => {
 			warn!("not sending get save");
 		}
@@ -356,16 +412,22 @@ async fn handle_message(client: &mut OwnedWriteHalf, message: ToServer) -> Resul
 			)
 			.await
 			.context("failed to write advance packet")?,
-		ToServer::StartScript => client
-			.write_all(
-				PacketHeader {
-					packet_type: PacketType::StartScript as _,
-					size: 0.into(),
-				}
-				.as_bytes(),
-			)
-			.await
-			.context("failed to write start packet")?,
+		ToServer::StartScript { replay_id } => {
+			client
+				.write_all(
+					PacketHeader {
+						packet_type: PacketType::StartScript as _,
+						size: U32::new(size_of::<u32>() as u32),
+					}
+					.as_bytes(),
+				)
+				.await
+				.context("failed to write start packet header")?;
+			client
+				.write_all(&replay_id.to_le_bytes())
+				.await
+				.context("failed to write start packet")?
+		}
 		ToServer::StopScript => client
 			.write_all(
 				PacketHeader {
@@ -396,6 +458,22 @@ async fn handle_message(client: &mut OwnedWriteHalf, message: ToServer) -> Resul
 				.await
 				.context("failed to write tool data")?
 		}
+		ToServer::Desync { frame_index } => {
+			client
+				.write_all(
+					PacketHeader {
+						packet_type: PacketType::Desync as _,
+						size: U32::new(size_of::<u32>() as u32),
+					}
+					.as_bytes(),
+				)
+				.await
+				.context("failed to write desync packet header")?;
+			client
+				.write_all(&frame_index.to_le_bytes())
+				.await
+				.context("failed to write desync packet")?
+		}
 	}
 
 	client.flush().await.context("failed to flush")?;
@@ -403,7 +481,39 @@ async fn handle_message(client: &mut OwnedWriteHalf, message: ToServer) -> Resul
 	Ok(())
 }
 
-async fn udp_task(ui: mpsc::UnboundedSender<ToUi>) {
+async fn write_script_info(
+	client: &mut OwnedWriteHalf,
+	packet_type: PacketType,
+	frame_count: u32,
+	player_count: u8,
+	controller_types: [u8; 2],
+) -> Result<()> {
+	client
+		.write_all(
+			PacketHeader {
+				packet_type: packet_type as _,
+				size: U32::new(size_of::<ScriptInfo>() as u32),
+			}
+			.as_bytes(),
+		)
+		.await
+		.context("failed to write script info packet header")?;
+	let mut script_info = ScriptInfo::new_zeroed();
+	script_info.frame_count = U32::new(frame_count);
+	script_info.player_count = player_count;
+	script_info.controller_types = controller_types;
+	client
+		.write_all(script_info.as_bytes())
+		.await
+		.context("failed to write script info")?;
+	Ok(())
+}
+
+async fn udp_task(
+	ui: mpsc::UnboundedSender<ToUi>,
+	credit: watch::Sender<FrameCredit>,
+	mut desync: mpsc::UnboundedReceiver<DesyncMessage>,
+) {
 	let udp = UdpSocket::bind("0.0.0.0:8171")
 		.await
 		.expect("failed to bind udp server on 8171");
@@ -415,9 +525,16 @@ async fn udp_task(ui: mpsc::UnboundedSender<ToUi>) {
 	);
 
 	let mut buffer = [0; 800];
+	let mut last_sequence: Option<u32> = None;
+	let mut frame_timing = FrameTiming::new();
+	let mut desync_checker = DesyncChecker::new();
 	loop {
 		let (size, addr) = udp.recv_from(&mut buffer).await.unwrap();
 		let buffer = &buffer[..size];
+		// the checker only acts on telemetry, so messages for it only need to be in before the next record
+		while let Ok(message) = desync.try_recv() {
+			desync_checker.handle(message);
+		}
 
 		match handle_udp_message(buffer).await {
 			Ok(UdpMessage::Ui(to_ui)) => {
@@ -425,6 +542,49 @@ async fn udp_task(ui: mpsc::UnboundedSender<ToUi>) {
 					return;
 				}
 			}
+			Ok(UdpMessage::Telemetry(records)) => {
+				for record in &records {
+					if let Some(last) = last_sequence {
+						let lost = record.sequence.wrapping_sub(last).wrapping_sub(1);
+						// the client restarting its counter isn't loss
+						if lost != 0 && lost < u32::MAX / 2 {
+							warn!("lost {lost} frames of telemetry before {}", record.sequence);
+						}
+					}
+					last_sequence = Some(record.sequence);
+					frame_timing.push(record);
+					if let Some(frame_index) = desync_checker.push(record) {
+						if let Err(_) = ui.send(ToUi::Desync { frame_index }) {
+							return;
+						}
+					}
+				}
+
+				if let Some(record) = records.last() {
+					credit.send_replace(FrameCredit {
+						replay_id: record.replay_id,
+						frames_released: record.frames_released,
+						buffer_capacity: record.buffer_capacity,
+					});
+				}
+
+				// the ui only shows the latest frame
+				let Some(record) = records.into_iter().last() else {
+					continue;
+				};
+				if record.flags & TelemetryRecord::HAS_POSITION != 0 {
+					if let Err(_) = ui.send(ToUi::ReportPosition {
+						position: record.position,
+					}) {
+						return;
+					}
+				}
+				if record.flags & TelemetryRecord::HAS_INPUT != 0 {
+					if let Err(_) = ui.send(ToUi::InputReport(record.input)) {
+						return;
+					}
+				}
+			}
 			Ok(UdpMessage::DiscoveryReply) => {
 				if 0 == udp
 					.send_to(b"hi", addr)
@@ -443,6 +603,7 @@ async fn udp_task(ui: mpsc::UnboundedSender<ToUi>) {
 
 enum UdpMessage {
 	Ui(ToUi),
+	Telemetry(Vec<TelemetryRecord>),
 	DiscoveryReply,
 }
 
@@ -464,6 +625,16 @@ async fn handle_udp_message(data: &[u8]) -> Result<UdpMessage> {
 
 			Ok(UdpMessage::Ui(ToUi::InputReport(input)))
 		}
+		PacketType::Telemetry => {
+			let records = data
+				.chunks_exact(size_of::<TelemetryRecord>())
+				.map(|record| TelemetryRecord::read_from_bytes(record).unwrap())
+				.collect::<Vec<_>>();
+			if records.is_empty() {
+				bail!("empty telemetry packet");
+			}
+			Ok(UdpMessage::Telemetry(records))
+		}
 		PacketType::UDPDiscovery => Ok(UdpMessage::DiscoveryReply),
 		packet_type => bail!("unexpected packet type: {packet_type:?}"),
 	}
@@ -5,9 +5,11 @@ use tas_script_formats::{
 };
 use zerocopy::{
 	FromBytes, Immutable, IntoBytes, KnownLayout, Unalign,
-	little_endian::{U32, U64},
+	little_endian::{U16, U32, U64},
 };
 
+/// No gyro: the client has nowhere to write a controller's angular velocity, so scripts that use
+/// it are refused by the script sender instead.
 #[derive(FromBytes, IntoBytes, KnownLayout, Immutable)]
 #[repr(C, align(4))]
 pub struct Controller {
@@ -15,9 +17,7 @@ pub struct Controller {
 	pub left_stick: IVec2,
 	pub right_stick: IVec2,
 	pub accel_left: Vec3,
-	pub gyro_left: Vec3,
 	pub accel_right: Vec3,
-	pub gyro_right: Vec3,
 }
 
 #[derive(FromBytes, IntoBytes, KnownLayout, Immutable)]
@@ -31,6 +31,14 @@ pub struct FramePacket {
 	pub amiibo: U64,
 }
 
+#[derive(FromBytes, IntoBytes, KnownLayout, Immutable)]
+#[repr(C)]
+pub struct FrameDeltaHeader {
+	pub server_index: U32,
+	pub frame_index: U32,
+	pub frame_count: U16,
+}
+
 // #[derive(FromBytes, IntoBytes, KnownLayout, Immutable)]
 // #[repr(C)]
 // pub struct ServerInfoPacket {
@@ -56,6 +64,40 @@ pub struct InputReport {
 	pub attributes: u32,
 }
 
+/// One game frame of telemetry. Several of these can be packed into a single `Telemetry` datagram.
+#[derive(FromBytes, KnownLayout, Immutable)]
+#[repr(C)]
+pub struct TelemetryRecord {
+	/// Counts up once per game frame, so gaps mean lost datagrams
+	pub sequence: u32,
+	pub frame_index: u32,
+	pub server_index: u32,
+	pub flags: u32,
+	pub position: Vec3,
+	/// Frames of replay `replay_id` the client has taken out of its frame buffer
+	pub frames_released: u32,
+	pub input: InputReport,
+	pub replay_id: u32,
+	pub buffer_capacity: u32,
+	/// Console system tick at the start of the frame, see [`crate::server::frame_timing`]
+	pub tick: u64,
+	/// Hash of the game state after this frame, see [`crate::server::desync`]
+	pub state_hash: u32,
+}
+
+const _: () = assert!(size_of::<TelemetryRecord>() == 96);
+
+impl TelemetryRecord {
+	pub const HAS_POSITION: u32 = 1 << 0;
+	pub const HAS_INPUT: u32 = 1 << 1;
+	pub const REPLAYING: u32 = 1 << 2;
+	pub const PAUSED: u32 = 1 << 3;
+	/// The game was held back because the client's frame buffer was empty
+	pub const BLOCKED: u32 = 1 << 4;
+	/// The scene updated this frame, so `state_hash` is set
+	pub const HAS_STATE_HASH: u32 = 1 << 5;
+}
+
 #[derive(FromPrimitive, Debug)]
 pub enum PacketType {
 	ServerInfo = 0,
@@ -77,12 +119,22 @@ pub enum PacketType {
 	ReloadStage = 16,
 	ReportInput = 17,
 	UpdateTool = 18,
+	FrameBatch = 19,
+	FrameDelta = 20,
+	CacheBegin = 21,
+	CacheBlock = 22,
+	CacheEnd = 23,
+	StartCachedScript = 24,
+	Telemetry = 25,
+	Desync = 26,
 }
 
 #[derive(ToPrimitive, Debug)]
 pub enum ToolType {
 	ShowUi = 0,
 	AlwaysUncollectedMoons = 1,
+	TelemetryBatch = 2,
+	FastForward = 3,
 }
 
 #[derive(Debug, FromBytes, IntoBytes, KnownLayout, Immutable)]
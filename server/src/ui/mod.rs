@@ -4,7 +4,7 @@ mod piano;
 mod script_info;
 mod tools;
 
-use std::{fmt::Write as FmtWrite, path::PathBuf, sync::Arc};
+use std::{collections::HashSet, fmt::Write as FmtWrite, path::PathBuf, sync::Arc};
 
 use eframe::{
 	CreationContext, Frame,
@@ -13,14 +13,18 @@ use eframe::{
 use egui_dock::TabViewer;
 use eyre::{Context, Result, bail};
 use tas_script_formats::{Buttons, ChangeStage, Script, glam::Vec3};
-use tokio::sync::mpsc;
+use tokio::sync::{mpsc, watch};
 
 pub use tools::Tools;
 
 use crate::{
 	config::Config,
-	script_sender::{ScriptMessage, script_sender},
-	server::{ToServer, ToUi, server_task},
+	script_sender::{ScriptMessage, script_sender, uses_gyro},
+	server::{
+		FrameCredit, ToServer, ToUi,
+		desync::{DesyncMessage, ScriptKey, script_key},
+		server_task,
+	},
 	tracked_value::TrackedValue,
 	ui::input_display::InputDisplay,
 };
@@ -50,12 +54,15 @@ impl TabType {
 struct ActiveScript {
 	path: PathBuf,
 	script: Arc<Script>,
+	/// Picks out the script's reference run for desync checks
+	key: ScriptKey,
 }
 
 pub(super) struct State {
 	script_sender: mpsc::Sender<ScriptMessage>,
 	server_sender: mpsc::UnboundedSender<ToServer>,
 	ui_receiver: mpsc::UnboundedReceiver<ToUi>,
+	desync_sender: mpsc::UnboundedSender<DesyncMessage>,
 
 	should_open_dialog: bool,
 	config: Config,
@@ -65,6 +72,10 @@ pub(super) struct State {
 	input_display: InputDisplay,
 	stage: Option<(String, i32)>,
 	player_position: Option<Vec3>,
+	/// Scripts whose desync reference is pinned
+	pinned_references: HashSet<ScriptKey>,
+	/// Script last cached on the console this session
+	cached_script: Option<ScriptKey>,
 	monospace: FontId,
 }
 
@@ -73,8 +84,15 @@ impl State {
 		let (to_ui, mut from_server_repainter) = mpsc::unbounded_channel();
 		let (to_server, from_ui) = mpsc::unbounded_channel();
 		let (to_script_manager, from_state) = mpsc::channel(4);
-		tokio::spawn(server_task(to_ui.clone(), from_ui));
-		tokio::spawn(script_sender(from_state, to_ui, to_server.clone()));
+		let (credit_sender, credit) = watch::channel(FrameCredit::default());
+		let (desync_sender, desync_receiver) = mpsc::unbounded_channel();
+		tokio::spawn(server_task(
+			to_ui.clone(),
+			from_ui,
+			credit_sender,
+			desync_receiver,
+		));
+		tokio::spawn(script_sender(from_state, to_ui, to_server.clone(), credit));
 		let context = _ctx.egui_ctx.clone();
 		let mut font_definitions = FontDefinitions::default();
 		let mut font_data = FontData::from_static(include_bytes!("./assets/ComicShanns2.ttf"));
@@ -105,6 +123,7 @@ impl State {
 			script_sender: to_script_manager,
 			server_sender: to_server,
 			ui_receiver: from_server,
+			desync_sender,
 
 			should_open_dialog: false,
 			config: Config::load(),
@@ -114,6 +133,8 @@ impl State {
 			input_display: InputDisplay::new(),
 			stage: None,
 			player_position: None,
+			pinned_references: HashSet::new(),
+			cached_script: None,
 			monospace,
 		};
 
@@ -195,6 +216,12 @@ impl State {
 					scenario,
 				} => self.stage = Some((stage_name, scenario)),
 				ToUi::ReportPosition { position } => self.player_position = Some(position),
+				ToUi::Desync { frame_index } => {
+					writeln!(&mut self.log, "server: desync at frame {frame_index}").unwrap();
+					self.server_sender
+						.send(ToServer::Desync { frame_index })
+						.expect("channel closed");
+				}
 				ToUi::InputReport(report) => {
 					self.input_display.update(
 						Buttons::new(),
@@ -209,12 +236,23 @@ impl State {
 	fn try_loading_script(&mut self, path: &PathBuf) -> Result<ActiveScript> {
 		let result = std::fs::read(path)
 			.wrap_err("failed to read script file from disk")
-			.and_then(|script| tas_script_formats::parse(&script));
+			.and_then(|contents| {
+				tas_script_formats::parse(&contents).map(|script| (script, script_key(&contents)))
+			});
 
 		match result {
-			Ok(script) => Ok(ActiveScript {
+			// refused rather than played without its motion, which would desync without a word
+			Ok((script, _)) if uses_gyro(&script) => {
+				let _ = writeln!(
+					&mut self.log,
+					"server: script uses gyro, which can't be replayed yet"
+				);
+				bail!("script uses gyro");
+			}
+			Ok((script, key)) => Ok(ActiveScript {
 				path: path.clone(),
 				script: script.into(),
+				key,
 			}),
 			Err(report) => {
 				let _ = writeln!(&mut self.log, "server: failed to load script");
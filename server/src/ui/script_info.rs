@@ -1,6 +1,10 @@
 use eframe::egui::{Button, ComboBox, Grid, TextEdit, Ui, Vec2};
 
-use crate::{State, script_sender::ScriptMessage, server::ToServer};
+use crate::{
+	State,
+	script_sender::ScriptMessage,
+	server::{ToServer, desync::DesyncMessage},
+};
 
 impl State {
 	pub fn script_info_ui(&mut self, ui: &mut Ui) {
@@ -61,6 +65,9 @@ impl State {
 						y: ui.min_size().y,
 					};
 					if ui.add_sized(i, Button::new("Run")).clicked() {
+						self.desync_sender
+							.send(DesyncMessage::Script(Some(script.key)))
+							.unwrap();
 						self.script_sender
 							.blocking_send(ScriptMessage::Start)
 							.unwrap()
@@ -76,6 +83,45 @@ impl State {
 					if ui.add_sized(i, Button::new("Frame advance")).clicked() {
 						self.server_sender.send(ToServer::AdvanceFrame).unwrap()
 					}
+					ui.end_row();
+					if ui.add_sized(i, Button::new("Cache on console")).clicked() {
+						self.cached_script = Some(script.key);
+						self.script_sender
+							.blocking_send(ScriptMessage::Cache)
+							.unwrap()
+					}
+					if ui.add_sized(i, Button::new("Run cached")).clicked() {
+						self.desync_sender
+							.send(DesyncMessage::Script(self.cached_script))
+							.unwrap();
+						self.script_sender
+							.blocking_send(ScriptMessage::StartCached)
+							.unwrap()
+					}
+					// the reference is the run later replays of this script are checked against
+					let pinned = self.pinned_references.contains(&script.key);
+					if ui
+						.add_sized(i, Button::new("Pin reference").selected(pinned))
+						.clicked()
+					{
+						if pinned {
+							self.pinned_references.remove(&script.key);
+						} else {
+							self.pinned_references.insert(script.key);
+						}
+						self.desync_sender
+							.send(DesyncMessage::Pin {
+								script: script.key,
+								pinned: !pinned,
+							})
+							.unwrap()
+					}
+					if ui.add_sized(i, Button::new("Clear reference")).clicked() {
+						self.pinned_references.remove(&script.key);
+						self.desync_sender
+							.send(DesyncMessage::Clear(script.key))
+							.unwrap()
+					}
 				});
 
 			Grid::new("script-info-grid").num_columns(2).show(ui, |ui| {
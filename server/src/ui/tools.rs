@@ -15,9 +15,23 @@ use crate::{
 pub struct Tools {
 	show_ui: TrackedValue<bool>,
 	always_uncollected_moons: TrackedValue<bool>,
+	/// Game frames per telemetry datagram
+	#[serde(default = "default_telemetry_batch")]
+	telemetry_batch: TrackedValue<u8>,
+	/// Game frames run per drawn frame while replaying
+	#[serde(default = "default_fast_forward")]
+	fast_forward: TrackedValue<u8>,
 	change_stage_info: ChangeStageInfo,
 }
 
+fn default_telemetry_batch() -> TrackedValue<u8> {
+	1.into()
+}
+
+fn default_fast_forward() -> TrackedValue<u8> {
+	1.into()
+}
+
 #[derive(Default, Serialize, Deserialize)]
 pub struct ChangeStageInfo {
 	pub stage_name: TrackedValue<String>,
@@ -33,6 +47,8 @@ impl Default for Tools {
 		Self {
 			show_ui: true.into(),
 			always_uncollected_moons: true.into(),
+			telemetry_batch: default_telemetry_batch(),
+			fast_forward: default_fast_forward(),
 			change_stage_info: ChangeStageInfo {
 				stage_name: "CurrentWorldHome".to_owned().into(),
 				scenario_no: (1i32).into(),
@@ -75,6 +91,18 @@ impl State {
 		};
 		tracking_checkbox(ui, "Show UI", &mut tools.show_ui);
 		tracking_checkbox(ui, "Reactivate moons", &mut tools.always_uncollected_moons);
+		ui.horizontal(|ui| {
+			ui.label("Telemetry frames per packet");
+			tracking(ui, &mut tools.telemetry_batch, |ui, value| {
+				ui.add(DragValue::new(value).range(1..=4))
+			});
+		});
+		ui.horizontal(|ui| {
+			ui.label("Fast forward (frames per draw)");
+			tracking(ui, &mut tools.fast_forward, |ui, value| {
+				ui.add(DragValue::new(value).range(1..=16))
+			});
+		});
 		Grid::new("change-stage-info").show(ui, |ui| {
 			ui.label("Stage name");
 			tracking_string(ui, &mut tools.change_stage_info.stage_name, |ui, value| {
@@ -123,19 +151,24 @@ impl State {
 					}))
 					.expect("game closed");
 			}
+			if ui.button("Reload stage").clicked() {
+				self.server_sender
+					.send(ToServer::ReloadStage)
+					.expect("game closed");
+			}
 		});
 	}
 
 	pub fn tools_tracking(&mut self) -> bool {
-		fn track_bool_tool(
-			value: &mut TrackedValue<bool>,
+		fn track_tool<T: Copy + Into<u8>>(
+			value: &mut TrackedValue<T>,
 			tool: ToolType,
 			sender: &mut UnboundedSender<ToServer>,
 		) -> bool {
 			let changed = value.has_changed();
 			value.if_changed(|value| {
 				sender
-					.send(ToServer::UpdateTool(tool, [*value as u8].into()))
+					.send(ToServer::UpdateTool(tool, [(*value).into()].into()))
 					.unwrap();
 			});
 			changed
@@ -147,16 +180,26 @@ impl State {
 		}
 		let tools = &mut self.config.tools;
 		let mut updated = false;
-		updated |= track_bool_tool(
+		updated |= track_tool(
 			&mut tools.show_ui,
 			ToolType::ShowUi,
 			&mut self.server_sender,
 		);
-		updated |= track_bool_tool(
+		updated |= track_tool(
 			&mut tools.always_uncollected_moons,
 			ToolType::AlwaysUncollectedMoons,
 			&mut self.server_sender,
 		);
+		updated |= track_tool(
+			&mut tools.telemetry_batch,
+			ToolType::TelemetryBatch,
+			&mut self.server_sender,
+		);
+		updated |= track_tool(
+			&mut tools.fast_forward,
+			ToolType::FastForward,
+			&mut self.server_sender,
+		);
 		updated |= track_unsynced(&mut tools.change_stage_info.stage_name);
 		updated |= track_unsynced(&mut tools.change_stage_info.entrance_id);
 		updated |= track_unsynced(&mut tools.change_stage_info.scenario_no);